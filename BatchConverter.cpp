@@ -0,0 +1,283 @@
+#include "BatchConverter.hpp"
+#include "CacheDirectory.hpp"
+#include "FrameSink.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// a ustar header for a regular file; names over 100 bytes are split into
+// prefix and name at a '/', false when that is impossible
+bool tarHeader(const std::string &name, size_t size, char header[512]) {
+  std::memset(header, 0, 512);
+  std::string prefix;
+  std::string base = name;
+  if (name.size() > 100) {
+    size_t slash = name.rfind('/', 155);
+    if (slash == std::string::npos || name.size() - slash - 1 > 100) {
+      return false;
+    }
+    prefix = name.substr(0, slash);
+    base = name.substr(slash + 1);
+  }
+  std::memcpy(header, base.data(), base.size());
+  std::snprintf(header + 100, 8, "%07o", 0644);
+  std::snprintf(header + 108, 8, "%07o", 0);
+  std::snprintf(header + 116, 8, "%07o", 0);
+  std::snprintf(header + 124, 12, "%011llo",
+                static_cast<unsigned long long>(size));
+  std::snprintf(header + 136, 12, "%011llo",
+                static_cast<unsigned long long>(std::time(nullptr)));
+  header[156] = '0';
+  std::memcpy(header + 257, "ustar", 6);
+  std::memcpy(header + 263, "00", 2);
+  std::memcpy(header + 345, prefix.data(), prefix.size());
+
+  // the checksum is computed with its own field as spaces
+  std::memset(header + 148, ' ', 8);
+  unsigned sum = 0;
+  for (int i = 0; i < 512; i++) {
+    sum += static_cast<unsigned char>(header[i]);
+  }
+  std::snprintf(header + 148, 8, "%06o", sum);
+  return true;
+}
+
+} // namespace
+
+BatchConverter::BatchConverter(const ImageRenderer::RenderOptions &options,
+                               int threads)
+    : options(options),
+      threads(threads > 0 ? threads
+                          : std::max(1u, std::thread::hardware_concurrency())),
+      queues(this->threads) {
+  // the images are the parallelism, each one renders in a single band
+  this->options.threads = 1;
+  this->options.progressive = false;
+  this->options.animate = false;
+}
+
+bool BatchConverter::isImage(const std::string &path) {
+  std::string extension = fs::path(path).extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  // .img is how ImageCache stores downloads
+  static const char *const extensions[] = {".jpg", ".jpeg", ".png", ".webp",
+                                           ".bmp", ".gif",  ".tif", ".tiff",
+                                           ".img"};
+  for (const char *known : extensions) {
+    if (extension == known) {
+      return true;
+    }
+  }
+  return false;
+}
+
+long BatchConverter::convert(const std::string &inputDir,
+                             const std::string &output) {
+  this->inputDir = inputDir;
+  std::error_code ec;
+  inputs.clear();
+  for (fs::recursive_directory_iterator it(inputDir, ec), end;
+       !ec && it != end; it.increment(ec)) {
+    if (it->is_regular_file(ec) && isImage(it->path().string())) {
+      inputs.push_back(it->path().string());
+    }
+  }
+  if (ec) {
+    std::cerr << "Error: Cannot read " << inputDir << ": " << ec.message()
+              << std::endl;
+    return -1;
+  }
+  std::sort(inputs.begin(), inputs.end());
+
+  const bool toArchive =
+      output.size() > 4 && output.compare(output.size() - 4, 4, ".tar") == 0;
+  if (toArchive) {
+    outputDir.clear();
+    archive = std::fopen(output.c_str(), "wb");
+    if (!archive) {
+      std::cerr << "Error: Cannot create " << output << std::endl;
+      return -1;
+    }
+  } else {
+    outputDir = output;
+    if (!fs::create_directories(outputDir, ec) && ec) {
+      std::cerr << "Error: Cannot create " << output << ": " << ec.message()
+                << std::endl;
+      return -1;
+    }
+  }
+
+  // frames made with other options are all rendered again
+  char optionsKey[17];
+  std::snprintf(optionsKey, sizeof(optionsKey), "%016llx",
+                static_cast<unsigned long long>(
+                    ImageRenderer().optionsKey(options)));
+  const std::string optionsPath = outputDir + "/" + OPTIONS_FILE;
+  std::string recorded;
+  reuseFrames = !toArchive &&
+                CacheDirectory::readFile(optionsPath, recorded) &&
+                recorded == optionsKey;
+  if (!toArchive && !reuseFrames) {
+    // the frames are about to change, so until this run completes none of
+    // them may be taken for frames of the recorded options
+    fs::remove(optionsPath, ec);
+    if (ec) {
+      std::cerr << "Error: Cannot remove " << optionsPath << ": "
+                << ec.message() << std::endl;
+      return -1;
+    }
+  }
+
+  // contiguous runs per thread keep each one in a single directory for as
+  // long as there is no stealing
+  for (size_t t = 0; t < threads; t++) {
+    queues[t].jobs.clear();
+    for (size_t i = inputs.size() * t / threads;
+         i < inputs.size() * (t + 1) / threads; i++) {
+      queues[t].jobs.push_back(i);
+    }
+  }
+
+  converted = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<size_t> failed(threads, 0);
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; t++) {
+    workers.emplace_back(&BatchConverter::work, this, t, std::ref(failed[t]));
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+  long failures = 0;
+  for (size_t count : failed) {
+    failures += static_cast<long>(count);
+  }
+  if (archive) {
+    // two zero blocks end a tar archive
+    static const char end[1024] = {};
+    if (std::fwrite(end, 1, sizeof(end), archive) != sizeof(end) ||
+        std::fclose(archive) != 0) {
+      std::cerr << "Error: Failed to write " << output << std::endl;
+      failures = -1;
+    }
+    archive = nullptr;
+  } else if (failures == 0 && !reuseFrames &&
+             !CacheDirectory::writeFile(optionsPath, optionsKey,
+                                        sizeof(optionsKey) - 1)) {
+    // an image that failed may have left a stale frame, so the options are
+    // only recorded once every frame matches them
+    std::cerr << "Error: Failed to write " << optionsPath << std::endl;
+    failures = -1;
+  }
+  std::cerr << "\rConverted " << converted << "/" << inputs.size()
+            << " images in " << seconds << " s" << std::endl;
+  return failures;
+}
+
+bool BatchConverter::take(size_t self, size_t &job) {
+  {
+    std::lock_guard<std::mutex> lock(queues[self].mutex);
+    if (!queues[self].jobs.empty()) {
+      job = queues[self].jobs.front();
+      queues[self].jobs.pop_front();
+      return true;
+    }
+  }
+  // stealing from the far end, away from where the owner is working
+  for (size_t k = 1; k < threads; k++) {
+    WorkQueue &victim = queues[(self + k) % threads];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.jobs.empty()) {
+      job = victim.jobs.back();
+      victim.jobs.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void BatchConverter::work(size_t self, size_t &failed) {
+  ImageRenderer renderer;
+  std::string frame;
+  size_t job;
+  while (take(self, job)) {
+    if (!convertOne(renderer, inputs[job], frame)) {
+      std::cerr << "Failed to convert " << inputs[job] << std::endl;
+      failed++;
+      continue;
+    }
+    size_t done = ++converted;
+    if (done % 100 == 0) {
+      std::cerr << "\rConverted " << done << "/" << inputs.size()
+                << std::flush;
+    }
+  }
+}
+
+std::string BatchConverter::outputPath(const std::string &input) const {
+  fs::path relative = fs::path(input).lexically_relative(inputDir);
+  // appended rather than replaced, so a.jpg and a.png do not collide
+  return relative.generic_string() + FRAME_EXTENSION;
+}
+
+bool BatchConverter::convertOne(ImageRenderer &renderer,
+                                const std::string &input,
+                                std::string &frame) {
+  const std::string name = outputPath(input);
+
+  // frames newer than their image are left alone, so reruns with the same
+  // options only convert what changed
+  std::string target;
+  std::error_code ec;
+  if (!archive) {
+    target = outputDir + "/" + name;
+    std::error_code missing;
+    auto rendered = fs::last_write_time(target, missing);
+    auto modified = fs::last_write_time(input, ec);
+    if (reuseFrames && !missing && !ec && rendered >= modified) {
+      return true;
+    }
+    fs::create_directories(fs::path(target).parent_path(), ec);
+  }
+
+  frame.clear();
+  StringSink sink(frame);
+  if (!renderer.renderFile(input, options, sink)) {
+    return false;
+  }
+  return archive ? appendToArchive(name, frame)
+                 : CacheDirectory::writeFile(target, frame.data(),
+                                             frame.size());
+}
+
+bool BatchConverter::appendToArchive(const std::string &name,
+                                     const std::string &frame) {
+  char header[512];
+  if (!tarHeader(name, frame.size(), header)) {
+    std::cerr << "Error: Name too long for the archive: " << name
+              << std::endl;
+    return false;
+  }
+  static const char padding[512] = {};
+  const size_t padded = (512 - frame.size() % 512) % 512;
+
+  std::lock_guard<std::mutex> lock(archiveMutex);
+  return std::fwrite(header, 1, sizeof(header), archive) == sizeof(header) &&
+         std::fwrite(frame.data(), 1, frame.size(), archive) ==
+             frame.size() &&
+         std::fwrite(padding, 1, padded, archive) == padded;
+}
@@ -0,0 +1,67 @@
+#ifndef BATCH_CONVERTER_HPP
+#define BATCH_CONVERTER_HPP
+
+#include "ImageRenderer.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @class BatchConverter
+ * @brief Renders every image below a directory to an ASCII frame, on all
+ * cores, with no network involved.
+ *
+ * Images are spread over per-thread queues in directory order; a thread
+ * that runs dry steals from the back of another's queue, so a few huge
+ * images cannot leave the other cores idle. Frames go either to a mirror
+ * of the input tree (`<image name>.ans`) or, when the output ends in
+ * `.tar`, into a single tar archive. In a directory, frames newer than
+ * their image are kept as long as the render options match those recorded
+ * in OPTIONS_FILE by the last complete run.
+ */
+class BatchConverter {
+public:
+  static constexpr const char *FRAME_EXTENSION = ".ans";
+  static constexpr const char *OPTIONS_FILE = ".waifu-fetch-options";
+
+  // `threads` 0 uses every core; each thread renders one image at a time
+  BatchConverter(const ImageRenderer::RenderOptions &options, int threads);
+
+  // converts every image below `inputDir`; returns the number of images
+  // that failed, or -1 (with a message on stderr) when the output cannot
+  // be created
+  long convert(const std::string &inputDir, const std::string &output);
+
+private:
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<size_t> jobs;
+  };
+
+  ImageRenderer::RenderOptions options;
+  size_t threads;
+  std::vector<std::string> inputs;
+  std::string inputDir;
+  std::string outputDir;
+  // whether frames from an earlier run with the same options may be kept
+  bool reuseFrames = false;
+  std::vector<WorkQueue> queues;
+  std::atomic<size_t> converted{0};
+  // the archive, when writing one, and the lock for appending to it
+  FILE *archive = nullptr;
+  std::mutex archiveMutex;
+
+  static bool isImage(const std::string &path);
+  bool take(size_t self, size_t &job);
+  void work(size_t self, size_t &failed);
+  bool convertOne(ImageRenderer &renderer, const std::string &input,
+                  std::string &frame);
+  std::string outputPath(const std::string &input) const;
+  bool appendToArchive(const std::string &name, const std::string &frame);
+};
+
+#endif // BATCH_CONVERTER_HPP
@@ -0,0 +1,237 @@
+#include "BulkDownloader.hpp"
+#include "CacheDirectory.hpp"
+#include <cstdio>
+#include <curl/curl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+BulkDownloader::BulkDownloader(std::string directory)
+    : BulkDownloader(std::move(directory), Options()) {}
+
+BulkDownloader::BulkDownloader(std::string directory,
+                               const BulkDownloader::Options &options)
+    : directory(std::move(directory)), options(options) {
+  std::error_code ec;
+  fs::create_directories(this->directory, ec);
+  loadState();
+}
+
+void BulkDownloader::loadState() {
+  std::ifstream state(directory + "/" + STATE_FILE);
+  std::string url;
+  while (std::getline(state, url)) {
+    if (!url.empty()) {
+      known.insert(url);
+    }
+  }
+}
+
+void BulkDownloader::recordDone(const std::string &url) {
+  std::ofstream state(directory + "/" + STATE_FILE, std::ios::app);
+  state << url << '\n';
+}
+
+std::string BulkDownloader::hostOf(const std::string &url) {
+  size_t begin = url.find("://");
+  begin = begin == std::string::npos ? 0 : begin + 3;
+  return url.substr(begin, url.find('/', begin) - begin);
+}
+
+std::string BulkDownloader::pathFor(const std::string &url) const {
+  // the last path segment, which for the API's CDN is a unique file name
+  size_t end = url.find_first_of("?#");
+  if (end == std::string::npos) {
+    end = url.size();
+  }
+  size_t begin = url.rfind('/', end - 1);
+  begin = begin == std::string::npos ? 0 : begin + 1;
+  std::string name = url.substr(begin, end - begin);
+  if (name.empty() || name == "." || name == "..") {
+    char hashed[17];
+    std::snprintf(hashed, sizeof(hashed), "%016llx",
+                  static_cast<unsigned long long>(
+                      CacheDirectory::hash(url.data(), url.size())));
+    name = hashed;
+  }
+  return directory + "/" + name;
+}
+
+void BulkDownloader::add(const std::string &url) {
+  if (!known.insert(url).second) {
+    return;
+  }
+  Job job;
+  job.url = url;
+  job.path = pathFor(url);
+  pending.push_back(std::move(job));
+}
+
+bool BulkDownloader::start(BulkDownloader::Job &job,
+                           BulkDownloader::Transfer &transfer) {
+  const std::string part = job.path + ".part";
+  std::error_code ec;
+  uintmax_t offset = fs::file_size(part, ec);
+  if (ec) {
+    offset = 0;
+  }
+  transfer.file = std::fopen(part.c_str(), offset > 0 ? "ab" : "wb");
+  if (!transfer.file) {
+    std::cerr << "Failed to open " << part << std::endl;
+    return false;
+  }
+  transfer.resumed = offset > 0;
+
+  // one session per transfer, streaming into its own .part file
+  transfer.session = std::make_shared<cpr::Session>();
+  cpr::Session &session = *transfer.session;
+  session.SetUrl(cpr::Url{job.url});
+  session.SetConnectTimeout(cpr::ConnectTimeout{options.connectTimeoutMs});
+  session.SetLowSpeed(
+      cpr::LowSpeed{options.lowSpeedBytes, options.lowSpeedSeconds});
+  if (offset > 0) {
+    session.SetRange(
+        cpr::Range{static_cast<std::int64_t>(offset), std::nullopt});
+  }
+  FILE *file = transfer.file;
+  session.SetWriteCallback(
+      cpr::WriteCallback{[file](const std::string_view &data, intptr_t) {
+        return std::fwrite(data.data(), 1, data.size(), file) == data.size();
+      }});
+  session.PrepareGet();
+  transfer.job = std::move(job);
+  return true;
+}
+
+BulkDownloader::Outcome
+BulkDownloader::finish(BulkDownloader::Transfer &transfer,
+                       const cpr::Response &response) {
+  Job &job = transfer.job;
+  std::fclose(transfer.file);
+  transfer.file = nullptr;
+  if (stats) {
+    stats->addResponse(response);
+  }
+
+  const std::string part = job.path + ".part";
+  // whether the file holds a clean prefix of the image: a partial response
+  // continues it, a full one only counts on a fresh file
+  const bool validPrefix = response.status_code == 206 ||
+                           (response.status_code == 200 && !transfer.resumed) ||
+                           response.status_code == 0;
+  std::error_code ec;
+  if (validPrefix && response.status_code != 0 && !response.error) {
+    fs::rename(part, job.path, ec);
+    if (!ec) {
+      recordDone(job.url);
+      return DONE;
+    }
+  }
+
+  // error pages and bodies appended after a prefix are useless, while an
+  // interrupted transfer resumes from where it stopped
+  if (!validPrefix) {
+    fs::remove(part, ec);
+  }
+  if (++job.attempts < options.attempts) {
+    pending.push_back(std::move(job));
+    return RETRY;
+  }
+  std::cerr << "Failed to download " << job.url
+            << ". Status: " << response.status_code << std::endl;
+  return FAILED;
+}
+
+size_t BulkDownloader::run() {
+  const size_t total = pending.size();
+  size_t done = 0;
+  size_t failed = 0;
+
+  CURLM *multi = curl_multi_init();
+  if (!multi) {
+    std::cerr << "Failed to start the transfer loop" << std::endl;
+    return pending.size();
+  }
+  std::unordered_map<CURL *, Transfer> running;
+  std::unordered_map<std::string, int> perHost;
+
+  Stats::Timer timer(stats, Stats::DOWNLOAD);
+  for (;;) {
+    // topping the loop up in queue order, skipping hosts that are full
+    for (auto it = pending.begin();
+         it != pending.end() &&
+         running.size() < static_cast<size_t>(options.concurrency);) {
+      int &hostRunning = perHost[hostOf(it->url)];
+      if (hostRunning >= options.perHost) {
+        ++it;
+        continue;
+      }
+      Transfer transfer;
+      if (!start(*it, transfer)) {
+        failed++;
+      } else {
+        CURL *handle = transfer.session->GetCurlHolder()->handle;
+        curl_multi_add_handle(multi, handle);
+        running.emplace(handle, std::move(transfer));
+        hostRunning++;
+      }
+      it = pending.erase(it);
+    }
+    if (running.empty()) {
+      break;
+    }
+
+    int stillRunning = 0;
+    if (curl_multi_perform(multi, &stillRunning) != CURLM_OK) {
+      std::cerr << "Failed to run the transfer loop" << std::endl;
+      break;
+    }
+
+    bool finished = false;
+    int queuedMessages = 0;
+    while (CURLMsg *message = curl_multi_info_read(multi, &queuedMessages)) {
+      if (message->msg != CURLMSG_DONE) {
+        continue;
+      }
+      auto it = running.find(message->easy_handle);
+      if (it == running.end()) {
+        continue;
+      }
+      // the result has to be read before the handle leaves the loop
+      const CURLcode result = message->data.result;
+      curl_multi_remove_handle(multi, it->first);
+      Transfer transfer = std::move(it->second);
+      running.erase(it);
+      perHost[hostOf(transfer.job.url)]--;
+
+      Outcome outcome = finish(transfer, transfer.session->Complete(result));
+      done += outcome == DONE;
+      failed += outcome == FAILED;
+      finished = true;
+      std::cerr << "\rDownloaded " << done << "/" << total << std::flush;
+    }
+    if (!finished &&
+        curl_multi_poll(multi, nullptr, 0, 1000, nullptr) != CURLM_OK) {
+      std::cerr << "Failed to run the transfer loop" << std::endl;
+      break;
+    }
+  }
+
+  // whatever is left after a loop failure counts as failed
+  for (auto &entry : running) {
+    curl_multi_remove_handle(multi, entry.first);
+    std::fclose(entry.second.file);
+  }
+  failed += running.size() + pending.size();
+  running.clear();
+  pending.clear();
+  curl_multi_cleanup(multi);
+  std::cerr << std::endl;
+  return failed;
+}
@@ -0,0 +1,93 @@
+#ifndef BULK_DOWNLOADER_HPP
+#define BULK_DOWNLOADER_HPP
+
+#include "Stats.hpp"
+#include <cpr/cpr.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+/**
+ * @class BulkDownloader
+ * @brief Downloads many images concurrently into a directory, driving all
+ * transfers from one libcurl multi event loop.
+ *
+ * The transfers are cpr sessions, prepared and completed the way
+ * cpr::MultiPerform does it, but added to the loop one by one: the next
+ * queued URL starts as soon as a transfer finishes, so a slow download never
+ * holds up the others.
+ *
+ * Each transfer streams straight into a `.part` file that is renamed once
+ * complete. Finished URLs are appended to a state file in the directory, so
+ * an interrupted job skips what it already has and resumes partial files
+ * with a Range request.
+ */
+class BulkDownloader {
+public:
+  struct Options {
+    // transfers running at the same time
+    int concurrency = 32;
+    // transfers to the same host at the same time; every image of the API
+    // comes from one CDN host, so this caps the effective concurrency
+    int perHost = 8;
+    // attempts per URL before it counts as failed
+    int attempts = 3;
+    // a transfer slower than lowSpeedBytes per second for lowSpeedSeconds
+    // is aborted (and retried), so stalled servers cannot use up the slots
+    int lowSpeedBytes = 1024;
+    int lowSpeedSeconds = 20;
+    int connectTimeoutMs = 10000;
+  };
+
+  static constexpr const char *STATE_FILE = ".waifu-fetch-state";
+
+  explicit BulkDownloader(std::string directory);
+  BulkDownloader(std::string directory, const Options &options);
+
+  // queues `url` unless it is already queued or recorded as downloaded
+  void add(const std::string &url);
+  size_t queued() const { return pending.size(); }
+
+  // downloads everything queued; returns the number of URLs that failed
+  size_t run();
+
+  // records every transfer into `stats` (not owned, may be null)
+  void setStats(Stats *stats) { this->stats = stats; }
+
+private:
+  struct Job {
+    std::string url;
+    std::string path;
+    int attempts = 0;
+  };
+
+  // a job in the event loop
+  struct Transfer {
+    Job job;
+    std::shared_ptr<cpr::Session> session;
+    FILE *file = nullptr;
+    bool resumed = false;
+  };
+
+  std::string directory;
+  Options options;
+  Stats *stats = nullptr;
+  std::list<Job> pending;
+  std::unordered_set<std::string> known;
+
+  enum Outcome { DONE, RETRY, FAILED };
+
+  bool start(Job &job, Transfer &transfer);
+  // handles a finished transfer, queueing it again for another attempt
+  Outcome finish(Transfer &transfer, const cpr::Response &response);
+  void loadState();
+  void recordDone(const std::string &url);
+  std::string pathFor(const std::string &url) const;
+  static std::string hostOf(const std::string &url);
+};
+
+#endif // BULK_DOWNLOADER_HPP
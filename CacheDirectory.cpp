@@ -0,0 +1,125 @@
+#include "CacheDirectory.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+CacheDirectory::CacheDirectory(std::string path, uint64_t maxBytes)
+    : directory(std::move(path)), maxBytes(maxBytes) {
+  std::error_code ec;
+  fs::create_directories(directory, ec);
+}
+
+uint64_t CacheDirectory::hash(const void *data, size_t size, uint64_t seed) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  uint64_t hash = seed;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+std::string CacheDirectory::pathFor(uint64_t key,
+                                    const char *extension) const {
+  static const char hex[] = "0123456789abcdef";
+  std::string name(16, '0');
+  for (int i = 15; i >= 0; i--) {
+    name[i] = hex[key & 15];
+    key >>= 4;
+  }
+  return directory + "/" + name + extension;
+}
+
+bool CacheDirectory::readFile(const std::string &path,
+                              std::string &contents) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    return false;
+  }
+  std::streamsize size = file.tellg();
+  if (size < 0) {
+    return false;
+  }
+  contents.resize(static_cast<size_t>(size));
+  file.seekg(0);
+  return static_cast<bool>(file.read(&contents[0], size));
+}
+
+bool CacheDirectory::writeFile(const std::string &path, const char *data,
+                               size_t size) {
+  // unique per process and thread, as workers of one process may store
+  // the same entry at the same time
+  const std::string tmp =
+      path + ".tmp" + std::to_string(getpid()) + "." +
+      std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  {
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    if (!file || !file.write(data, static_cast<std::streamsize>(size))) {
+      return false;
+    }
+  }
+  std::error_code ec;
+  fs::rename(tmp, path, ec);
+  if (ec) {
+    fs::remove(tmp, ec);
+    return false;
+  }
+  return true;
+}
+
+void CacheDirectory::touch(const std::string &path) {
+  std::error_code ec;
+  fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+}
+
+void CacheDirectory::trim(const char *extension, const char *companion) {
+  struct File {
+    fs::file_time_type lastUse;
+    uintmax_t size;
+    fs::path path;
+  };
+  std::vector<File> files;
+  uintmax_t total = 0;
+
+  std::error_code ec;
+  for (fs::directory_iterator it(directory, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    if (it->path().extension() != extension) {
+      continue;
+    }
+    std::error_code statError;
+    uintmax_t size = it->file_size(statError);
+    fs::file_time_type lastUse = it->last_write_time(statError);
+    if (statError) {
+      continue;
+    }
+    files.push_back({lastUse, size, it->path()});
+    total += size;
+  }
+  if (total <= maxBytes) {
+    return;
+  }
+
+  std::sort(files.begin(), files.end(), [](const File &a, const File &b) {
+    return a.lastUse < b.lastUse;
+  });
+  for (const File &file : files) {
+    if (total <= maxBytes) {
+      break;
+    }
+    if (companion) {
+      fs::path other = file.path;
+      other.replace_extension(companion);
+      fs::remove(other, ec);
+    }
+    fs::remove(file.path, ec);
+    total -= file.size;
+  }
+}
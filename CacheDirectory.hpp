@@ -0,0 +1,46 @@
+#ifndef CACHE_DIRECTORY_HPP
+#define CACHE_DIRECTORY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @class CacheDirectory
+ * @brief A directory of files named by 64-bit keys and kept under a size
+ * limit, shared by the image and frame caches.
+ *
+ * Files are replaced atomically (temp file + rename), so other processes
+ * reading the same cache never see a partial file, and a file's
+ * modification time doubles as its last use for LRU eviction.
+ */
+class CacheDirectory {
+public:
+  static constexpr uint64_t HASH_SEED = 14695981039346656037ull;
+
+  CacheDirectory(std::string path, uint64_t maxBytes);
+
+  // 64-bit FNV-1a, chainable by passing the previous hash as seed
+  static uint64_t hash(const void *data, size_t size,
+                       uint64_t seed = HASH_SEED);
+
+  const std::string &path() const { return directory; }
+  // <directory>/<key as 16 hex digits><extension>
+  std::string pathFor(uint64_t key, const char *extension) const;
+
+  static bool readFile(const std::string &path, std::string &contents);
+  static bool writeFile(const std::string &path, const char *data,
+                        size_t size);
+  // marks a file as just used
+  static void touch(const std::string &path);
+
+  // deletes the least recently used files ending in `extension`, together
+  // with their `companion` file if given, until those fit in maxBytes
+  void trim(const char *extension, const char *companion = nullptr);
+
+private:
+  std::string directory;
+  uint64_t maxBytes;
+};
+
+#endif // CACHE_DIRECTORY_HPP
@@ -0,0 +1,115 @@
+#include "CellGrid.hpp"
+
+namespace {
+
+void appendColor(uint32_t color, bool foreground, FrameBuffer &out) {
+  const uint32_t value = color & 0xFFFFFF;
+  out.append("\x1b[");
+  switch (color >> 24) {
+  case CellGrid::RGB:
+    out.append(foreground ? "38;2;" : "48;2;", 5);
+    out.appendUInt(value >> 16);
+    out.append(';');
+    out.appendUInt((value >> 8) & 0xFF);
+    out.append(';');
+    out.appendUInt(value & 0xFF);
+    break;
+  case CellGrid::INDEXED:
+    out.append(foreground ? "38;5;" : "48;5;", 5);
+    out.appendUInt(value);
+    break;
+  default:
+    // the ANSI kind keeps the SGR code itself
+    out.appendUInt(value);
+    break;
+  }
+  out.append('m');
+}
+
+// brings the terminal from colors fg/bg to the cell's, resetting first
+// when one of them has to go back to the default
+void setColors(const CellGrid::Cell &cell, uint32_t &fg, uint32_t &bg,
+               FrameBuffer &out) {
+  if ((cell.fg == 0 && fg != 0) || (cell.bg == 0 && bg != 0)) {
+    out.append("\x1b[0m");
+    fg = 0;
+    bg = 0;
+  }
+  if (cell.fg != fg) {
+    appendColor(cell.fg, true, out);
+    fg = cell.fg;
+  }
+  if (cell.bg != bg) {
+    appendColor(cell.bg, false, out);
+    bg = cell.bg;
+  }
+}
+
+void moveCursor(const char *direction, int count, FrameBuffer &out) {
+  out.append("\x1b[");
+  out.appendUInt(count);
+  out.append(direction, 1);
+}
+
+} // namespace
+
+void CellGrid::appendDiff(const CellGrid &shown, FrameBuffer &out) const {
+  uint32_t fg = 0, bg = 0;
+  if (shown.width != width || shown.height != height) {
+    // nothing to diff against, clearing and drawing the whole grid
+    if (shown.height > 0) {
+      moveCursor("A", shown.height, out);
+    }
+    out.append("\r\x1b[J");
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        const Cell &cell = at(y, x);
+        setColors(cell, fg, bg, out);
+        out.append(cell.glyph.bytes, cell.glyph.length);
+      }
+      if (fg != 0 || bg != 0) {
+        out.append("\x1b[0m");
+        fg = 0;
+        bg = 0;
+      }
+      out.append('\n');
+    }
+    return;
+  }
+
+  // the cursor starts below the grid, goes up to the first changed row and
+  // then only moves down and right; writing a glyph already advances it, so
+  // runs of changed cells need no positioning at all
+  int row = height, col = 0;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      const Cell &cell = at(y, x);
+      if (cell == shown.at(y, x)) {
+        continue;
+      }
+      if (y < row) {
+        moveCursor("A", row - y, out);
+        row = y;
+      } else if (y > row) {
+        moveCursor("B", y - row, out);
+        row = y;
+      }
+      if (x != col) {
+        // CHA, absolute column starting at 1
+        moveCursor("G", x + 1, out);
+      }
+      setColors(cell, fg, bg, out);
+      out.append(cell.glyph.bytes, cell.glyph.length);
+      col = x + 1;
+    }
+  }
+
+  if (row == height) {
+    return;
+  }
+  if (fg != 0 || bg != 0) {
+    out.append("\x1b[0m");
+  }
+  moveCursor("B", height - row, out);
+  out.append('\r');
+}
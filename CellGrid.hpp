@@ -0,0 +1,131 @@
+#ifndef CELL_GRID_HPP
+#define CELL_GRID_HPP
+
+#include "FrameBuffer.hpp"
+#include "GlyphTable.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+/**
+ * @class CellGrid
+ * @brief What a rendered frame puts in each terminal cell: glyph plus
+ * foreground and background color.
+ *
+ * Used for animation playback, where only the cells that differ from the
+ * previously shown frame are redrawn, so the bytes sent per frame grow with
+ * the motion in the image rather than with the grid size.
+ */
+class CellGrid {
+public:
+  // colors as kind << 24 | value, 0 being the terminal's default
+  enum ColorKind : uint32_t { RGB = 1, INDEXED = 2, ANSI = 3 };
+
+  struct Cell {
+    uint32_t fg = 0;
+    uint32_t bg = 0;
+    GlyphTable::Glyph glyph{};
+
+    bool operator==(const Cell &other) const {
+      return fg == other.fg && bg == other.bg &&
+             glyph.length == other.glyph.length &&
+             std::memcmp(glyph.bytes, other.glyph.bytes, glyph.length) == 0;
+    }
+    bool operator!=(const Cell &other) const { return !(*this == other); }
+  };
+
+  int rows() const { return height; }
+  int cols() const { return width; }
+  bool empty() const { return cells.empty(); }
+  const Cell &at(int row, int col) const {
+    return cells[static_cast<size_t>(row) * width + col];
+  }
+
+  // sizes the grid for `cols` x `rows` cells, which a Writer then fills
+  void resize(int cols, int rows) {
+    cells.resize(static_cast<size_t>(cols) * rows);
+    width = cols;
+    height = rows;
+  }
+
+  /**
+   * @class Writer
+   * @brief Fills grid cells from the same calls SgrWriter takes, so a
+   * renderer maps a frame straight to cells instead of to escapes.
+   *
+   * Colors within `tolerance` of the current one are kept just as SgrWriter
+   * keeps them, so a grid matches what the escape output would show.
+   */
+  class Writer {
+  public:
+    Writer(CellGrid &grid, int row, int tolerance = 0)
+        : next(grid.cells.data() + static_cast<size_t>(row) * grid.width),
+          tolerance(tolerance) {}
+
+    void background(int r, int g, int b) { setRgb(bg, r, g, b); }
+    void foreground(int r, int g, int b) { setRgb(fg, r, g, b); }
+    void background256(int index) { bg = makeColor(INDEXED, index); }
+    void foreground256(int index) { fg = makeColor(INDEXED, index); }
+    void background16(int index) {
+      bg = makeColor(ANSI, index < 8 ? 40 + index : 100 + index - 8);
+    }
+    void foreground16(int index) {
+      fg = makeColor(ANSI, index < 8 ? 30 + index : 90 + index - 8);
+    }
+
+    void reserve(size_t) {}
+
+    void glyph(const GlyphTable::Glyph &glyph) {
+      next->fg = fg;
+      next->bg = bg;
+      next->glyph = glyph;
+      next++;
+    }
+
+    void glyphRow(const GlyphTable &glyphs, const uint8_t *levels,
+                  int count) {
+      for (int i = 0; i < count; i++) {
+        glyph(glyphs.forLevel(levels[i]));
+      }
+    }
+
+    void endLine() {
+      fg = 0;
+      bg = 0;
+    }
+
+  private:
+    Cell *next;
+    int tolerance;
+    uint32_t fg = 0, bg = 0;
+
+    static uint32_t makeColor(ColorKind kind, int value) {
+      return static_cast<uint32_t>(kind) << 24 | static_cast<uint32_t>(value);
+    }
+
+    bool close(uint32_t color, int shift, int value) const {
+      return std::abs(static_cast<int>(color >> shift & 0xFF) - value) <=
+             tolerance;
+    }
+
+    void setRgb(uint32_t &color, int r, int g, int b) {
+      if (color >> 24 == RGB && close(color, 16, r) && close(color, 8, g) &&
+          close(color, 0, b)) {
+        return;
+      }
+      color = makeColor(RGB, r << 16 | g << 8 | b);
+    }
+  };
+
+  // appends the escapes redrawing `shown` as this grid, for a cursor that
+  // starts and ends at the start of the line below the grid
+  void appendDiff(const CellGrid &shown, FrameBuffer &out) const;
+
+private:
+  std::vector<Cell> cells;
+  int width = 0;
+  int height = 0;
+};
+
+#endif // CELL_GRID_HPP
@@ -0,0 +1,100 @@
+#include "CellSampler.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// first source index covered by output index `i`, blocks never shrink below
+// one source pixel so upscaling degrades to nearest-neighbour
+inline int blockStart(int i, int srcSize, int dstSize) {
+  return static_cast<int>(static_cast<int64_t>(i) * srcSize / dstSize);
+}
+
+} // namespace
+
+void CellSampler::prepare(const cv::Mat &src, int dstCols, double contrast,
+                          double brightness) {
+  if (!levelsReady || contrast != levelsContrast ||
+      brightness != levelsBrightness) {
+    for (int v = 0; v < 256; v++) {
+      double adjusted = std::round(v * contrast + brightness);
+      levels[v] =
+          static_cast<uint8_t>(std::min(255.0, std::max(0.0, adjusted)));
+    }
+    levelsContrast = contrast;
+    levelsBrightness = brightness;
+    levelsReady = true;
+  }
+
+  if (src.cols != boundsSrcCols || dstCols != boundsDstCols) {
+    colStart.resize(dstCols);
+    colEnd.resize(dstCols);
+    for (int x = 0; x < dstCols; x++) {
+      colStart[x] = blockStart(x, src.cols, dstCols);
+      colEnd[x] =
+          std::max(colStart[x] + 1, blockStart(x + 1, src.cols, dstCols));
+    }
+    boundsSrcCols = src.cols;
+    boundsDstCols = dstCols;
+  }
+
+  sums.resize(static_cast<size_t>(dstCols) * 3);
+}
+
+void CellSampler::reserve(int maxCols) {
+  colStart.reserve(maxCols);
+  colEnd.reserve(maxCols);
+  sums.reserve(static_cast<size_t>(maxCols) * 3);
+}
+
+void CellSampler::sample(const cv::Mat &src, double contrast,
+                         double brightness, cv::Mat &color, cv::Mat &luma,
+                         int rowBegin, int rowEnd) {
+  const int dstCols = color.cols;
+  const int dstRows = color.rows;
+  prepare(src, dstCols, contrast, brightness);
+
+  for (int y = rowBegin; y < rowEnd; y++) {
+    int y0 = blockStart(y, src.rows, dstRows);
+    int y1 = std::max(y0 + 1, blockStart(y + 1, src.rows, dstRows));
+
+    std::fill(sums.begin(), sums.end(), 0);
+    // walking whole source rows keeps the reads sequential
+    for (int sy = y0; sy < y1; sy++) {
+      const uint8_t *row = src.ptr<uint8_t>(sy);
+      uint32_t *acc = sums.data();
+      for (int x = 0; x < dstCols; x++, acc += 3) {
+        const uint8_t *p = row + colStart[x] * 3;
+        const uint8_t *end = row + colEnd[x] * 3;
+        uint32_t b = 0, g = 0, r = 0;
+        for (; p < end; p += 3) {
+          b += p[0];
+          g += p[1];
+          r += p[2];
+        }
+        acc[0] += b;
+        acc[1] += g;
+        acc[2] += r;
+      }
+    }
+
+    uint8_t *colorRow = color.ptr<uint8_t>(y);
+    uint8_t *lumaRow = luma.ptr<uint8_t>(y);
+    const uint32_t *acc = sums.data();
+    for (int x = 0; x < dstCols; x++, acc += 3) {
+      uint32_t area =
+          static_cast<uint32_t>((colEnd[x] - colStart[x]) * (y1 - y0));
+      uint32_t half = area / 2;
+      int b = levels[(acc[0] + half) / area];
+      int g = levels[(acc[1] + half) / area];
+      int r = levels[(acc[2] + half) / area];
+
+      colorRow[x * 3] = static_cast<uint8_t>(b);
+      colorRow[x * 3 + 1] = static_cast<uint8_t>(g);
+      colorRow[x * 3 + 2] = static_cast<uint8_t>(r);
+      // same fixed-point BT.601 weights as cv::COLOR_BGR2GRAY
+      lumaRow[x] =
+          static_cast<uint8_t>((r * 4899 + g * 9617 + b * 1868 + 8192) >> 14);
+    }
+  }
+}
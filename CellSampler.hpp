@@ -0,0 +1,44 @@
+#ifndef CELL_SAMPLER_HPP
+#define CELL_SAMPLER_HPP
+
+#include <array>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+/**
+ * @class CellSampler
+ * @brief Fused resize + contrast + grayscale kernel.
+ *
+ * Area-averages blocks of the full-resolution BGR source straight into the
+ * output cells, applying contrast and brightness to each average and
+ * deriving the luma plane in the same pass, so the source is read exactly
+ * once and no full-size intermediate images are created.
+ */
+class CellSampler {
+public:
+  // fills rows [rowBegin, rowEnd) of `color` (CV_8UC3) and `luma` (CV_8UC1),
+  // which must already be allocated at the output size
+  void sample(const cv::Mat &src, double contrast, double brightness,
+              cv::Mat &color, cv::Mat &luma, int rowBegin, int rowEnd);
+
+  // pre-sizes the per-row scratch for outputs up to maxCols wide
+  void reserve(int maxCols);
+
+private:
+  std::array<uint8_t, 256> levels;
+  double levelsContrast = 1.0;
+  double levelsBrightness = 0.0;
+  bool levelsReady = false;
+
+  std::vector<int> colStart, colEnd;
+  int boundsSrcCols = -1;
+  int boundsDstCols = -1;
+
+  std::vector<uint32_t> sums;
+
+  void prepare(const cv::Mat &src, int dstCols, double contrast,
+               double brightness);
+};
+
+#endif // CELL_SAMPLER_HPP
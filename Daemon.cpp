@@ -0,0 +1,232 @@
+#include "Daemon.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void onStopSignal(int) { stopRequested = 1; }
+
+bool toAddress(const std::string &path, sockaddr_un &address) {
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    std::cerr << "Error: Socket path too long: " << path << std::endl;
+    return false;
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+} // namespace
+
+std::string Daemon::defaultSocketPath() {
+  const char *runtime = std::getenv("XDG_RUNTIME_DIR");
+  if (runtime && *runtime) {
+    return std::string(runtime) + "/waifu-fetch.sock";
+  }
+  return "/tmp/waifu-fetch-" + std::to_string(getuid()) + ".sock";
+}
+
+Daemon::Daemon(std::string socketPath) : socketPath(std::move(socketPath)) {}
+
+Daemon::~Daemon() {
+  if (listenFd >= 0) {
+    close(listenFd);
+    unlink(socketPath.c_str());
+  }
+}
+
+int Daemon::connectTo(const std::string &socketPath) {
+  sockaddr_un address;
+  if (!toAddress(socketPath, address)) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) <
+      0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool Daemon::sendAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    // a client that went away must not kill the daemon with SIGPIPE
+    ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += sent;
+    size -= static_cast<size_t>(sent);
+  }
+  return true;
+}
+
+bool Daemon::listen() {
+  sockaddr_un address;
+  if (!toAddress(socketPath, address)) {
+    return false;
+  }
+
+  // a socket file nobody answers on is left over from a daemon that died
+  int existing = connectTo(socketPath);
+  if (existing >= 0) {
+    close(existing);
+    std::cerr << "Error: A daemon is already listening on " << socketPath
+              << std::endl;
+    return false;
+  }
+  struct stat status;
+  if (lstat(socketPath.c_str(), &status) == 0) {
+    // only ever a socket is replaced, never a file the path points at
+    if (!S_ISSOCK(status.st_mode)) {
+      std::cerr << "Error: Not a socket: " << socketPath << std::endl;
+      return false;
+    }
+    unlink(socketPath.c_str());
+  }
+
+  listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listenFd < 0) {
+    std::cerr << "Error: Cannot create socket: " << std::strerror(errno)
+              << std::endl;
+    return false;
+  }
+  // only the owner may connect, requests run with the daemon's privileges
+  mode_t mask = umask(0077);
+  int bound =
+      bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+  umask(mask);
+  if (bound < 0 || ::listen(listenFd, SOMAXCONN) < 0) {
+    std::cerr << "Error: Cannot listen on " << socketPath << ": "
+              << std::strerror(errno) << std::endl;
+    close(listenFd);
+    listenFd = -1;
+    return false;
+  }
+  return true;
+}
+
+void Daemon::serve(const Daemon::Handler &handler) {
+  // without SA_RESTART the signals interrupt accept(), so the loop ends and
+  // the destructor removes the socket
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  action.sa_handler = onStopSignal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  while (!stopRequested) {
+    int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EINTR) {
+        std::cerr << "Error: accept failed: " << std::strerror(errno)
+                  << std::endl;
+      }
+      continue;
+    }
+    handle(fd, handler);
+    close(fd);
+  }
+}
+
+void Daemon::handle(int fd, const Daemon::Handler &handler) {
+  timeval timeout{REQUEST_TIMEOUT_SECONDS, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  // a suspended client must not block every request after it
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  // reading up to the empty argument that ends the list
+  std::string request;
+  char chunk[4096];
+  while (request.size() < 2 ||
+         request.compare(request.size() - 2, 2, "\0\0", 2) != 0) {
+    ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0 || request.size() + received > MAX_REQUEST_BYTES) {
+      return;
+    }
+    request.append(chunk, static_cast<size_t>(received));
+  }
+
+  std::vector<std::string> args;
+  for (size_t begin = 0; begin < request.size() - 1;) {
+    size_t end = request.find('\0', begin);
+    args.push_back(request.substr(begin, end - begin));
+    begin = end + 1;
+  }
+
+  std::string reply;
+  const char status = handler(args, reply) ? '0' : '1';
+  if (sendAll(fd, &status, 1)) {
+    sendAll(fd, reply.data(), reply.size());
+  }
+}
+
+bool Daemon::request(const std::string &socketPath,
+                     const std::vector<std::string> &args, FrameSink &out) {
+  int fd = connectTo(socketPath);
+  if (fd < 0) {
+    std::cerr << "Error: No daemon listening on " << socketPath
+              << ". Start one with --daemon." << std::endl;
+    return false;
+  }
+
+  // an empty argument would end the list early, and means nothing anyway
+  std::string request;
+  for (const std::string &arg : args) {
+    if (!arg.empty()) {
+      request.append(arg);
+      request.push_back('\0');
+    }
+  }
+  request.push_back('\0');
+
+  std::string reply;
+  bool sent = sendAll(fd, request.data(), request.size());
+  shutdown(fd, SHUT_WR);
+  char chunk[64 * 1024];
+  while (sent) {
+    ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      break;
+    }
+    reply.append(chunk, static_cast<size_t>(received));
+  }
+  close(fd);
+
+  if (reply.empty()) {
+    std::cerr << "Error: The daemon closed the connection without a reply."
+              << std::endl;
+    return false;
+  }
+  if (reply[0] != '0') {
+    std::cerr.write(reply.data() + 1, reply.size() - 1);
+    std::cerr.flush();
+    return false;
+  }
+  return out.write(reply.data() + 1, reply.size() - 1);
+}
@@ -0,0 +1,64 @@
+#ifndef DAEMON_HPP
+#define DAEMON_HPP
+
+#include "FrameSink.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @class Daemon
+ * @brief Serves render requests over a Unix socket, so that a long-running
+ * process keeps its HTTP connections, caches and renderer warm between
+ * invocations.
+ *
+ * A request is the client's command line arguments, each terminated by a
+ * NUL byte, and an empty argument to end the list. The reply is one status
+ * byte, '0' for success or '1' for failure, followed by the frame or by an
+ * error message, and ends when the daemon closes the connection.
+ */
+class Daemon {
+public:
+  // fills `reply` with the frame for `args`, or with an error message when
+  // returning false
+  using Handler = std::function<bool(const std::vector<std::string> &args,
+                                     std::string &reply)>;
+
+  // $XDG_RUNTIME_DIR/waifu-fetch.sock, or /tmp/waifu-fetch-<uid>.sock
+  static std::string defaultSocketPath();
+
+  explicit Daemon(std::string socketPath);
+  ~Daemon();
+
+  Daemon(const Daemon &) = delete;
+  Daemon &operator=(const Daemon &) = delete;
+
+  // creates the socket, replacing a stale one; false (with a message on
+  // stderr) when another daemon is already listening on it or the path is
+  // something other than a socket
+  bool listen();
+  // answers requests one at a time until SIGINT or SIGTERM
+  void serve(const Handler &handler);
+
+  // sends `args` to the daemon listening on `socketPath` and writes the
+  // frame it sends back to `out` in one write; false (with a message on
+  // stderr) when no daemon answers or the request failed
+  static bool request(const std::string &socketPath,
+                      const std::vector<std::string> &args, FrameSink &out);
+
+private:
+  // requests larger than this are rejected
+  static constexpr size_t MAX_REQUEST_BYTES = 64 * 1024;
+  // a client has this long to send its request, and to take each part of
+  // the reply, before the daemon moves on to the next one
+  static constexpr int REQUEST_TIMEOUT_SECONDS = 5;
+
+  std::string socketPath;
+  int listenFd = -1;
+
+  void handle(int fd, const Handler &handler);
+  static int connectTo(const std::string &socketPath);
+  static bool sendAll(int fd, const char *data, size_t size);
+};
+
+#endif // DAEMON_HPP
@@ -0,0 +1,22 @@
+#include "FrameBuffer.hpp"
+#include <utility>
+
+void FrameBuffer::reserve(size_t bytesNeeded) {
+  if (bytesNeeded > capacity) {
+    grow(bytesNeeded);
+  }
+}
+
+void FrameBuffer::grow(size_t required) {
+  size_t newCapacity = capacity == 0 ? 4096 : capacity;
+  while (newCapacity < required) {
+    newCapacity *= 2;
+  }
+
+  std::unique_ptr<char[]> newBytes(new char[newCapacity]);
+  if (used > 0) {
+    std::memcpy(newBytes.get(), bytes.get(), used);
+  }
+  bytes = std::move(newBytes);
+  capacity = newCapacity;
+}
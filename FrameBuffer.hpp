@@ -0,0 +1,68 @@
+#ifndef FRAME_BUFFER_HPP
+#define FRAME_BUFFER_HPP
+
+#include "FrameSink.hpp"
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+/**
+ * @class FrameBuffer
+ * @brief Growable byte buffer a whole frame is formatted into, so that it can
+ * be emitted with a single write instead of one stdio call per cell.
+ */
+class FrameBuffer {
+public:
+  void clear() { used = 0; }
+  void reserve(size_t bytes);
+
+  const char *data() const { return bytes.get(); }
+  size_t size() const { return used; }
+  bool empty() const { return used == 0; }
+
+  void append(char c) {
+    ensure(1);
+    bytes[used++] = c;
+  }
+
+  void append(const char *str, size_t len) {
+    ensure(len);
+    std::memcpy(bytes.get() + used, str, len);
+    used += len;
+  }
+
+  template <size_t N> void append(const char (&literal)[N]) {
+    append(literal, N - 1);
+  }
+
+  // formats an unsigned integer without going through printf
+  void appendUInt(unsigned value) {
+    char digits[10];
+    int n = 0;
+    do {
+      digits[n++] = static_cast<char>('0' + value % 10);
+      value /= 10;
+    } while (value != 0);
+
+    ensure(n);
+    while (n > 0) {
+      bytes[used++] = digits[--n];
+    }
+  }
+
+  bool writeTo(FrameSink &sink) const { return sink.write(data(), used); }
+
+private:
+  std::unique_ptr<char[]> bytes;
+  size_t used = 0;
+  size_t capacity = 0;
+
+  void ensure(size_t extra) {
+    if (used + extra > capacity) {
+      grow(used + extra);
+    }
+  }
+  void grow(size_t required);
+};
+
+#endif // FRAME_BUFFER_HPP
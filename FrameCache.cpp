@@ -0,0 +1,51 @@
+#include "FrameCache.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+void FrameCache::Mapping::reset() {
+  if (length > 0) {
+    munmap(const_cast<char *>(bytes), length);
+  }
+  bytes = nullptr;
+  length = 0;
+}
+
+FrameCache::FrameCache(std::string directory, uint64_t maxBytes)
+    : files(std::move(directory), maxBytes) {}
+
+bool FrameCache::lookup(uint64_t key, FrameCache::Mapping &mapping) {
+  mapping.reset();
+  const std::string path = files.pathFor(key, ".frame");
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+  void *bytes = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && info.st_size > 0) {
+    bytes = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ,
+                 MAP_PRIVATE, fd, 0);
+  }
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+  if (bytes == MAP_FAILED) {
+    return false;
+  }
+
+  mapping.bytes = static_cast<const char *>(bytes);
+  mapping.length = static_cast<size_t>(info.st_size);
+  CacheDirectory::touch(path);
+  return true;
+}
+
+bool FrameCache::store(uint64_t key, const char *data, size_t size) {
+  if (!CacheDirectory::writeFile(files.pathFor(key, ".frame"), data, size)) {
+    return false;
+  }
+  files.trim(".frame");
+  return true;
+}
@@ -0,0 +1,50 @@
+#ifndef FRAME_CACHE_HPP
+#define FRAME_CACHE_HPP
+
+#include "CacheDirectory.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @class FrameCache
+ * @brief On-disk cache of finished frames, keyed by a hash of the image
+ * bytes and of every option that changes the output.
+ *
+ * A hit skips decoding, resizing and glyph mapping altogether: the frame
+ * file is mapped read-only and handed to the sink in one write.
+ */
+class FrameCache {
+public:
+  static constexpr uint64_t DEFAULT_MAX_BYTES = 64ull * 1024 * 1024;
+
+  // read-only mapping of a cached frame, unmapped when destroyed
+  class Mapping {
+  public:
+    Mapping() = default;
+    Mapping(const Mapping &) = delete;
+    Mapping &operator=(const Mapping &) = delete;
+    ~Mapping() { reset(); }
+
+    const char *data() const { return bytes; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    void reset();
+
+  private:
+    friend class FrameCache;
+    const char *bytes = nullptr;
+    size_t length = 0;
+  };
+
+  explicit FrameCache(std::string directory,
+                      uint64_t maxBytes = DEFAULT_MAX_BYTES);
+
+  bool lookup(uint64_t key, Mapping &mapping);
+  bool store(uint64_t key, const char *data, size_t size);
+
+private:
+  CacheDirectory files;
+};
+
+#endif // FRAME_CACHE_HPP
@@ -0,0 +1,49 @@
+#include "FrameSink.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+bool FdSink::write(const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = ::write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+StdoutSink::StdoutSink() : FdSink(STDOUT_FILENO) {}
+
+bool StdoutSink::write(const char *data, size_t size) {
+  std::cout.flush();
+  fflush(stdout);
+  return FdSink::write(data, size);
+}
+
+bool OstreamSink::write(const char *data, size_t size) {
+  os.write(data, static_cast<std::streamsize>(size));
+  return static_cast<bool>(os);
+}
+
+bool StringSink::write(const char *data, size_t size) {
+  out.append(data, size);
+  return true;
+}
+
+bool BufferSink::write(const char *data, size_t size) {
+  required += size;
+  if (used + size > capacity) {
+    return false;
+  }
+  std::memcpy(buffer + used, data, size);
+  used += size;
+  return true;
+}
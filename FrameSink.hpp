@@ -0,0 +1,85 @@
+#ifndef FRAME_SINK_HPP
+#define FRAME_SINK_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+/**
+ * @class FrameSink
+ * @brief Destination for finished frames, so rendering does not depend on
+ * where the bytes end up (terminal, socket, string, benchmark).
+ */
+class FrameSink {
+public:
+  virtual ~FrameSink() = default;
+  virtual bool write(const char *data, size_t size) = 0;
+};
+
+// writes to a file descriptor, retrying partial and interrupted writes
+class FdSink : public FrameSink {
+public:
+  explicit FdSink(int fd) : fd(fd) {}
+  bool write(const char *data, size_t size) override;
+
+private:
+  int fd;
+};
+
+// stdout, flushing the iostream and stdio buffers first so that frames stay
+// ordered with any other output of the program
+class StdoutSink : public FdSink {
+public:
+  StdoutSink();
+  bool write(const char *data, size_t size) override;
+};
+
+class OstreamSink : public FrameSink {
+public:
+  explicit OstreamSink(std::ostream &os) : os(os) {}
+  bool write(const char *data, size_t size) override;
+
+private:
+  std::ostream &os;
+};
+
+// appends to a std::string owned by the caller
+class StringSink : public FrameSink {
+public:
+  explicit StringSink(std::string &out) : out(out) {}
+  bool write(const char *data, size_t size) override;
+
+private:
+  std::string &out;
+};
+
+// fills a fixed caller-provided buffer; a frame that does not fit is
+// rejected and `needed()` reports how large the buffer would have to be
+class BufferSink : public FrameSink {
+public:
+  BufferSink(char *buffer, size_t capacity)
+      : buffer(buffer), capacity(capacity) {}
+  bool write(const char *data, size_t size) override;
+
+  size_t size() const { return used; }
+  size_t needed() const { return required; }
+
+private:
+  char *buffer;
+  size_t capacity;
+  size_t used = 0;
+  size_t required = 0;
+};
+
+// discards everything, for measuring pure render throughput
+class NullSink : public FrameSink {
+public:
+  bool write(const char *, size_t size) override {
+    bytes += size;
+    return true;
+  }
+
+  size_t bytes = 0;
+};
+
+#endif // FRAME_SINK_HPP
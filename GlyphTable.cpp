@@ -0,0 +1,49 @@
+#include "GlyphTable.hpp"
+
+namespace {
+
+size_t utf8Length(unsigned char lead) {
+  if (lead < 0x80) {
+    return 1;
+  } else if ((lead >> 5) == 0x6) {
+    return 2;
+  } else if ((lead >> 4) == 0xE) {
+    return 3;
+  } else if ((lead >> 3) == 0x1E) {
+    return 4;
+  }
+  // stray continuation byte, treat it as a glyph on its own
+  return 1;
+}
+
+} // namespace
+
+GlyphTable::GlyphTable(const std::string &charSet) {
+  for (size_t i = 0; i < charSet.size();) {
+    size_t len = utf8Length(static_cast<unsigned char>(charSet[i]));
+    if (i + len > charSet.size()) {
+      len = charSet.size() - i;
+    }
+
+    Glyph glyph = {{' ', ' ', ' ', ' '}, static_cast<uint8_t>(len)};
+    charSet.copy(glyph.bytes, len, i);
+    glyphs.push_back(glyph);
+    i += len;
+  }
+
+  if (glyphs.empty()) {
+    glyphs.push_back({{' ', ' ', ' ', ' '}, 1});
+  }
+
+  const int maxIdx = static_cast<int>(glyphs.size()) - 1;
+  for (int level = 0; level < 256; level++) {
+    lut[level] = glyphs[level * maxIdx / 255];
+  }
+}
+
+void GlyphTable::encodeRow(const uint8_t *levels, int count,
+                           FrameBuffer &frame) const {
+  for (int i = 0; i < count; i++) {
+    append(frame, levels[i]);
+  }
+}
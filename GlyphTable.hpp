@@ -0,0 +1,44 @@
+#ifndef GLYPH_TABLE_HPP
+#define GLYPH_TABLE_HPP
+
+#include "FrameBuffer.hpp"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @class GlyphTable
+ * @brief Maps 8-bit brightness levels straight to pre-encoded UTF-8 glyphs.
+ *
+ * The character set is split once into glyphs of up to four bytes, and a
+ * 256-entry lookup table replaces the per-pixel division, so encoding a row
+ * is a table read and a fixed-size copy per cell.
+ */
+class GlyphTable {
+public:
+  struct Glyph {
+    char bytes[4];
+    uint8_t length;
+  };
+
+  explicit GlyphTable(const std::string &charSet);
+
+  const Glyph &forLevel(uint8_t level) const { return lut[level]; }
+  const Glyph &at(size_t index) const { return glyphs[index]; }
+  size_t size() const { return glyphs.size(); }
+
+  void append(FrameBuffer &frame, uint8_t level) const {
+    const Glyph &glyph = forLevel(level);
+    frame.append(glyph.bytes, glyph.length);
+  }
+
+  // encodes one row of brightness levels, without the trailing newline
+  void encodeRow(const uint8_t *levels, int count, FrameBuffer &frame) const;
+
+private:
+  std::vector<Glyph> glyphs;
+  std::array<Glyph, 256> lut;
+};
+
+#endif // GLYPH_TABLE_HPP
@@ -0,0 +1,22 @@
+#include "HttpClient.hpp"
+
+HttpClient::HttpClient() { session.SetConnectionPool(pool); }
+
+cpr::Response HttpClient::get(const std::string &url,
+                              const cpr::Header &header,
+                              const cpr::Parameters &parameters) {
+  std::lock_guard<std::mutex> lock(mutex);
+  // headers and parameters stick to the session, so every request sets
+  // both, empty ones included
+  session.SetUrl(cpr::Url{url});
+  session.SetHeader(header);
+  session.SetParameters(parameters);
+  return session.Get();
+}
+
+cpr::Response HttpClient::get(const std::string &url,
+                              const cpr::WriteCallback &onData) {
+  // a callback set on the shared session would stay for later requests, so
+  // streams get a handle of their own drawing on the same connections
+  return cpr::Get(cpr::Url{url}, onData, pool);
+}
@@ -0,0 +1,37 @@
+#ifndef HTTP_CLIENT_HPP
+#define HTTP_CLIENT_HPP
+
+#include <cpr/cpr.h>
+#include <mutex>
+#include <string>
+
+/**
+ * @class HttpClient
+ * @brief GET requests over warm connections: one persistent cpr::Session
+ * whose curl handle keeps its DNS cache and live connections between
+ * requests, plus a cpr::ConnectionPool shared with streaming transfers.
+ *
+ * A request to a host that was recently talked to reuses the open TCP and
+ * TLS connection instead of paying for new handshakes. Safe to share
+ * between threads; requests through the session are serialized.
+ */
+class HttpClient {
+public:
+  HttpClient();
+
+  HttpClient(const HttpClient &) = delete;
+  HttpClient &operator=(const HttpClient &) = delete;
+
+  cpr::Response get(const std::string &url,
+                    const cpr::Header &header = cpr::Header{},
+                    const cpr::Parameters &parameters = cpr::Parameters{});
+  // streams the body into `onData` instead of buffering it in the response
+  cpr::Response get(const std::string &url, const cpr::WriteCallback &onData);
+
+private:
+  cpr::ConnectionPool pool;
+  std::mutex mutex;
+  cpr::Session session;
+};
+
+#endif // HTTP_CLIENT_HPP
@@ -0,0 +1,443 @@
+#include "HttpServer.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+bool sendAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    // a client that went away must not kill the server with SIGPIPE
+    ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += sent;
+    size -= static_cast<size_t>(sent);
+  }
+  return true;
+}
+
+} // namespace
+
+HttpServer::HttpServer(const HttpServer::Options &options,
+                       HttpServer::Handler handler)
+    : options(options), handler(std::move(handler)) {
+  if (this->options.workers == 0) {
+    this->options.workers = 1;
+  }
+}
+
+HttpServer::~HttpServer() { stop(); }
+
+std::string HttpServer::statusText(int status) {
+  switch (status) {
+  case 200:
+    return "OK";
+  case 400:
+    return "Bad Request";
+  case 404:
+    return "Not Found";
+  case 405:
+    return "Method Not Allowed";
+  case 431:
+    return "Request Header Fields Too Large";
+  case 500:
+    return "Internal Server Error";
+  case 502:
+    return "Bad Gateway";
+  case 503:
+    return "Service Unavailable";
+  default:
+    return "Unknown";
+  }
+}
+
+bool HttpServer::start() {
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(static_cast<uint16_t>(options.port));
+  if (inet_pton(AF_INET, options.host.c_str(), &address.sin_addr) != 1) {
+    std::cerr << "Error: Not an IPv4 address: " << options.host << std::endl;
+    return false;
+  }
+
+  listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listenFd < 0) {
+    std::cerr << "Error: Cannot create socket: " << std::strerror(errno)
+              << std::endl;
+    return false;
+  }
+  int on = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  socklen_t length = sizeof(address);
+  if (bind(listenFd, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) < 0 ||
+      listen(listenFd, SOMAXCONN) < 0 ||
+      getsockname(listenFd, reinterpret_cast<sockaddr *>(&address),
+                  &length) < 0 ||
+      pipe2(wakeFds, O_CLOEXEC | O_NONBLOCK) < 0) {
+    std::cerr << "Error: Cannot listen on " << options.host << ":"
+              << options.port << ": " << std::strerror(errno) << std::endl;
+    close(listenFd);
+    listenFd = -1;
+    return false;
+  }
+  boundPort = ntohs(address.sin_port);
+
+  stopping = false;
+  acceptor = std::thread(&HttpServer::acceptLoop, this);
+  for (size_t i = 0; i < options.workers; i++) {
+    workers.emplace_back(&HttpServer::workerLoop, this, i);
+  }
+  return true;
+}
+
+void HttpServer::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (listenFd < 0) {
+      return;
+    }
+    stopping = true;
+    for (int fd : active) {
+      shutdown(fd, SHUT_RDWR);
+    }
+  }
+  wake();
+  notEmpty.notify_all();
+  if (acceptor.joinable()) {
+    acceptor.join();
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  workers.clear();
+
+  for (int fd : queue) {
+    close(fd);
+  }
+  queue.clear();
+  for (int fd : returned) {
+    close(fd);
+  }
+  returned.clear();
+  close(listenFd);
+  close(wakeFds[0]);
+  close(wakeFds[1]);
+  listenFd = -1;
+}
+
+void HttpServer::wake() {
+  const char byte = 0;
+  if (write(wakeFds[1], &byte, 1) < 0) {
+    // EAGAIN: the pipe is full, so the polling thread is woken already
+  }
+}
+
+void HttpServer::acceptLoop() {
+  static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                             "Content-Length: 0\r\n"
+                             "Connection: close\r\n\r\n";
+  using Clock = std::chrono::steady_clock;
+  const auto idleTimeout = std::chrono::milliseconds(options.idleTimeoutMs);
+  // idle keep-alive connections and since when they have been idle
+  std::vector<std::pair<int, Clock::time_point>> idle;
+  std::vector<pollfd> fds;
+
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (stopping) {
+        break;
+      }
+      for (int fd : returned) {
+        idle.emplace_back(fd, Clock::now());
+      }
+      returned.clear();
+    }
+
+    fds.assign({{listenFd, POLLIN, 0}, {wakeFds[0], POLLIN, 0}});
+    for (const auto &connection : idle) {
+      fds.push_back({connection.first, POLLIN, 0});
+    }
+    if (poll(fds.data(), fds.size(), 1000) < 0) {
+      continue;
+    }
+    if (fds[1].revents & POLLIN) {
+      char drain[64];
+      while (read(wakeFds[0], drain, sizeof(drain)) > 0) {
+        // until EAGAIN, one pass takes every wake-up so far
+      }
+    }
+
+    // connections with a new request (or a hang-up) go to the workers, the
+    // ones idle for too long are closed
+    std::vector<int> ready;
+    const auto now = Clock::now();
+    size_t kept = 0;
+    for (size_t i = 0; i < idle.size(); i++) {
+      if (fds[i + 2].revents) {
+        ready.push_back(idle[i].first);
+      } else if (now - idle[i].second > idleTimeout) {
+        close(idle[i].first);
+      } else {
+        idle[kept++] = idle[i];
+      }
+    }
+    idle.resize(kept);
+
+    int accepted = -1;
+    if (fds[0].revents & POLLIN) {
+      accepted = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    }
+    if (accepted >= 0) {
+      // frames go out in one send, there is nothing to coalesce
+      int on = 1;
+      setsockopt(accepted, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    // requests on open connections are always queued, the bound only
+    // turns away new clients
+    queue.insert(queue.end(), ready.begin(), ready.end());
+    const bool full = queue.size() + idle.size() >= options.queueDepth;
+    lock.unlock();
+    if (accepted >= 0 && full) {
+      sendAll(accepted, busy, sizeof(busy) - 1);
+      close(accepted);
+    } else if (accepted >= 0) {
+      // polled like a kept-alive connection until its request arrives
+      idle.emplace_back(accepted, Clock::now());
+    }
+    if (!ready.empty()) {
+      notEmpty.notify_all();
+    }
+  }
+
+  for (const auto &connection : idle) {
+    close(connection.first);
+  }
+}
+
+void HttpServer::workerLoop(size_t worker) {
+  while (true) {
+    int fd;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      notEmpty.wait(lock, [this] { return stopping || !queue.empty(); });
+      if (stopping) {
+        return;
+      }
+      fd = queue.front();
+      queue.pop_front();
+      active.insert(fd);
+    }
+    const bool keepAlive = serveConnection(fd, worker);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      active.erase(fd);
+      if (keepAlive && !stopping) {
+        returned.push_back(fd);
+        fd = -1;
+      }
+    }
+    if (fd < 0) {
+      wake();
+    } else {
+      close(fd);
+    }
+  }
+}
+
+bool HttpServer::serveConnection(int fd, size_t worker) {
+  timeval timeout{REQUEST_TIMEOUT_MS / 1000,
+                  (REQUEST_TIMEOUT_MS % 1000) * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  // otherwise a client that never reads holds on to this worker for good
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  // requests pipelined behind the first one are served right away, as
+  // their bytes are already read
+  std::string buffer;
+  char chunk[4096];
+  bool keepAlive = true;
+  do {
+    size_t headEnd;
+    while ((headEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+      if (buffer.size() > MAX_HEAD_BYTES) {
+        Response tooLarge;
+        tooLarge.status = 431;
+        sendResponse(fd, tooLarge, false);
+        return false;
+      }
+      ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+      if (received < 0 && errno == EINTR) {
+        continue;
+      }
+      if (received <= 0) {
+        return false;
+      }
+      buffer.append(chunk, static_cast<size_t>(received));
+    }
+
+    Request request;
+    size_t contentLength = 0;
+    Response response;
+    if (!parseHead(buffer.substr(0, headEnd), request, keepAlive,
+                   contentLength)) {
+      response.status = 400;
+      sendResponse(fd, response, false);
+      return false;
+    }
+
+    // request bodies mean nothing here, but have to be skipped
+    size_t consumed = headEnd + 4;
+    while (buffer.size() < consumed + contentLength) {
+      ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+      if (received < 0 && errno == EINTR) {
+        continue;
+      }
+      if (received <= 0) {
+        return false;
+      }
+      buffer.append(chunk, static_cast<size_t>(received));
+    }
+    buffer.erase(0, consumed + contentLength);
+
+    if (request.method != "GET") {
+      response.status = 405;
+    } else {
+      handler(request, response, worker);
+    }
+    if (!sendResponse(fd, response, keepAlive)) {
+      return false;
+    }
+  } while (keepAlive && !buffer.empty());
+  return keepAlive;
+}
+
+bool HttpServer::parseHead(const std::string &head,
+                           HttpServer::Request &request, bool &keepAlive,
+                           size_t &contentLength) {
+  // "GET /path?query HTTP/1.1"
+  size_t lineEnd = head.find("\r\n");
+  const std::string line = head.substr(0, lineEnd);
+  size_t methodEnd = line.find(' ');
+  size_t targetEnd = line.rfind(' ');
+  if (methodEnd == std::string::npos || targetEnd <= methodEnd) {
+    return false;
+  }
+  request.method = line.substr(0, methodEnd);
+  const std::string target =
+      line.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+  const std::string version = line.substr(targetEnd + 1);
+  if (version.compare(0, 5, "HTTP/") != 0) {
+    return false;
+  }
+
+  size_t queryBegin = target.find('?');
+  request.path = decode(target.substr(0, queryBegin));
+  if (queryBegin != std::string::npos) {
+    parseQuery(target.substr(queryBegin + 1), request.query);
+  }
+
+  // HTTP/1.1 keeps connections alive unless told otherwise, 1.0 the other
+  // way around
+  keepAlive = version != "HTTP/1.0";
+  contentLength = 0;
+  for (size_t begin = lineEnd;
+       begin != std::string::npos && begin < head.size();) {
+    begin += 2;
+    size_t end = head.find("\r\n", begin);
+    const std::string header = head.substr(begin, end - begin);
+    begin = end;
+
+    size_t colon = header.find(':');
+    if (colon == std::string::npos) {
+      continue;
+    }
+    const std::string name = header.substr(0, colon);
+    size_t valueBegin = header.find_first_not_of(" \t", colon + 1);
+    const std::string value =
+        valueBegin == std::string::npos ? "" : header.substr(valueBegin);
+    if (strcasecmp(name.c_str(), "Connection") == 0) {
+      if (strcasecmp(value.c_str(), "close") == 0) {
+        keepAlive = false;
+      } else if (strcasecmp(value.c_str(), "keep-alive") == 0) {
+        keepAlive = true;
+      }
+    } else if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+      contentLength = std::strtoul(value.c_str(), nullptr, 10);
+      if (contentLength > MAX_HEAD_BYTES) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void HttpServer::parseQuery(const std::string &query,
+                            std::map<std::string, std::string> &out) {
+  for (size_t begin = 0; begin <= query.size();) {
+    size_t end = std::min(query.find('&', begin), query.size());
+    const std::string pair = query.substr(begin, end - begin);
+    size_t equals = pair.find('=');
+    if (!pair.empty()) {
+      out[decode(pair.substr(0, equals))] =
+          equals == std::string::npos ? "" : decode(pair.substr(equals + 1));
+    }
+    begin = end + 1;
+  }
+}
+
+std::string HttpServer::decode(const std::string &text) {
+  std::string decoded;
+  decoded.reserve(text.size());
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == '+') {
+      decoded += ' ';
+    } else if (text[i] == '%' && i + 2 < text.size() &&
+               std::isxdigit(static_cast<unsigned char>(text[i + 1])) &&
+               std::isxdigit(static_cast<unsigned char>(text[i + 2]))) {
+      decoded += static_cast<char>(
+          std::strtol(text.substr(i + 1, 2).c_str(), nullptr, 16));
+      i += 2;
+    } else {
+      decoded += text[i];
+    }
+  }
+  return decoded;
+}
+
+bool HttpServer::sendResponse(int fd, const HttpServer::Response &response,
+                              bool keepAlive) {
+  // head and body leave in one send, so a frame never goes out in pieces
+  std::string message = "HTTP/1.1 " + std::to_string(response.status) + " " +
+                        statusText(response.status) + "\r\n";
+  message += "Content-Type: " + response.contentType + "\r\n";
+  message += "Content-Length: " + std::to_string(response.body.size()) +
+             "\r\n";
+  message += keepAlive ? "Connection: keep-alive\r\n\r\n"
+                       : "Connection: close\r\n\r\n";
+  message.reserve(message.size() + response.body.size());
+  message += response.body;
+  return sendAll(fd, message.data(), message.size());
+}
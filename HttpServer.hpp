@@ -0,0 +1,116 @@
+#ifndef HTTP_SERVER_HPP
+#define HTTP_SERVER_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class HttpServer
+ * @brief A minimal HTTP/1.1 server: one thread polling the listening socket
+ * and idle connections, feeding a bounded queue, and a fixed pool of
+ * workers serving one request at a time from it.
+ *
+ * Connections only reach a worker once a request has started to arrive:
+ * new ones are polled until then, and a worker hands a kept-alive one back
+ * to the polling thread once its response is out, so idle clients never
+ * hold a worker. Each worker has an index passed to the handler, letting
+ * it keep per-worker state without locking. New connections arriving while
+ * the queue is full are answered with 503 right away instead of piling up.
+ */
+class HttpServer {
+public:
+  struct Request {
+    std::string method;
+    std::string path;
+    // decoded query parameters, the last one winning for repeated names
+    std::map<std::string, std::string> query;
+  };
+
+  struct Response {
+    int status = 200;
+    std::string contentType = "text/plain; charset=utf-8";
+    std::string body;
+  };
+
+  // fills `response` for `request`; `worker` is the index of the calling
+  // worker, below Options::workers
+  using Handler = std::function<void(const Request &request,
+                                     Response &response, size_t worker)>;
+
+  struct Options {
+    // loopback only by default, the server has no authentication
+    std::string host = "127.0.0.1";
+    // 0 picks a free port, see port()
+    int port = 0;
+    size_t workers = 4;
+    // open connections waiting for a request or for a worker
+    size_t queueDepth = 64;
+    // a keep-alive connection idle this long is closed
+    int idleTimeoutMs = 15000;
+  };
+
+  HttpServer(const Options &options, Handler handler);
+  ~HttpServer();
+
+  HttpServer(const HttpServer &) = delete;
+  HttpServer &operator=(const HttpServer &) = delete;
+
+  // binds the socket and starts the threads; false (with a message on
+  // stderr) when the address cannot be bound
+  bool start();
+  // closes the socket and every open connection, then joins the threads
+  void stop();
+
+  // the port actually bound, once started
+  int port() const { return boundPort; }
+
+  static std::string statusText(int status);
+
+private:
+  // request heads larger than this are answered with 431
+  static constexpr size_t MAX_HEAD_BYTES = 16 * 1024;
+  // a request has to arrive completely within this once it has started,
+  // and a client that stops reading the response is dropped after it
+  static constexpr int REQUEST_TIMEOUT_MS = 5000;
+
+  Options options;
+  Handler handler;
+  int listenFd = -1;
+  // written to by stop() to wake the accepting thread
+  int wakeFds[2] = {-1, -1};
+  int boundPort = 0;
+
+  std::mutex mutex;
+  std::condition_variable notEmpty;
+  std::deque<int> queue;
+  // kept-alive connections handed back by workers, to be polled again
+  std::vector<int> returned;
+  // connections being served, shut down by stop() to unblock the workers
+  std::set<int> active;
+  bool stopping = false;
+  std::thread acceptor;
+  std::vector<std::thread> workers;
+
+  void wake();
+  void acceptLoop();
+  void workerLoop(size_t worker);
+  // serves the requests that arrived on `fd`; true when the connection is
+  // kept alive and idle
+  bool serveConnection(int fd, size_t worker);
+  static bool parseHead(const std::string &head, Request &request,
+                        bool &keepAlive, size_t &contentLength);
+  static void parseQuery(const std::string &query,
+                         std::map<std::string, std::string> &out);
+  static std::string decode(const std::string &text);
+  static bool sendResponse(int fd, const Response &response, bool keepAlive);
+};
+
+#endif // HTTP_SERVER_HPP
@@ -0,0 +1,152 @@
+#include "ImageCache.hpp"
+#include "HttpClient.hpp"
+#include <cpr/cpr.h>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+namespace {
+
+std::string headerValue(const cpr::Header &header, const char *name) {
+  auto it = header.find(name);
+  return it == header.end() ? std::string() : it->second;
+}
+
+// seconds the response may be reused without asking the server again;
+// false when it must not be stored at all
+bool parseCacheControl(const std::string &value, long long &maxAge) {
+  maxAge = 0;
+  if (value.find("no-store") != std::string::npos) {
+    return false;
+  }
+  if (value.find("no-cache") != std::string::npos) {
+    return true;
+  }
+  size_t pos = value.find("max-age=");
+  if (pos != std::string::npos) {
+    maxAge = std::atoll(value.c_str() + pos + 8);
+  }
+  return true;
+}
+
+} // namespace
+
+ImageCache::ImageCache(std::string directory, uint64_t maxBytes)
+    : files(std::move(directory), maxBytes) {}
+
+std::string ImageCache::defaultDirectory() {
+  const char *xdg = std::getenv("XDG_CACHE_HOME");
+  if (xdg && *xdg) {
+    return std::string(xdg) + "/waifu-fetch";
+  }
+  const char *home = std::getenv("HOME");
+  return std::string(home ? home : ".") + "/.cache/waifu-fetch";
+}
+
+std::string ImageCache::pathFor(const std::string &url,
+                                const char *extension) const {
+  return files.pathFor(CacheDirectory::hash(url.data(), url.size()),
+                       extension);
+}
+
+bool ImageCache::readEntry(const std::string &url, Entry &entry) const {
+  std::ifstream meta(pathFor(url, ".meta"));
+  std::string freshUntil;
+  if (!std::getline(meta, entry.url) || !std::getline(meta, entry.etag) ||
+      !std::getline(meta, entry.lastModified) ||
+      !std::getline(meta, freshUntil)) {
+    return false;
+  }
+  entry.freshUntil = std::atoll(freshUntil.c_str());
+  // a different URL with the same hash is a miss
+  return entry.url == url;
+}
+
+bool ImageCache::store(const ImageCache::Entry &entry,
+                       const std::string &body) {
+  // dropping the old metadata first, so it never describes the new body
+  std::remove(pathFor(entry.url, ".meta").c_str());
+  if (!CacheDirectory::writeFile(pathFor(entry.url, ".img"), body.data(),
+                                 body.size()) ||
+      !writeEntry(entry)) {
+    return false;
+  }
+  files.trim(".img", ".meta");
+  return true;
+}
+
+bool ImageCache::writeEntry(const ImageCache::Entry &entry) {
+  const std::string meta = entry.url + '\n' + entry.etag + '\n' +
+                           entry.lastModified + '\n' +
+                           std::to_string(entry.freshUntil) + '\n';
+  return CacheDirectory::writeFile(pathFor(entry.url, ".meta"), meta.data(),
+                                   meta.size());
+}
+
+bool ImageCache::fetch(const std::string &url, std::string &body) {
+  const std::string dataPath = pathFor(url, ".img");
+  const long long now = static_cast<long long>(std::time(nullptr));
+
+  Entry entry;
+  const bool cached = readEntry(url, entry);
+  if (cached && now < entry.freshUntil &&
+      CacheDirectory::readFile(dataPath, body)) {
+    CacheDirectory::touch(dataPath);
+    return true;
+  }
+
+  cpr::Header conditions;
+  if (cached && !entry.etag.empty()) {
+    conditions["If-None-Match"] = entry.etag;
+  }
+  if (cached && !entry.lastModified.empty()) {
+    conditions["If-Modified-Since"] = entry.lastModified;
+  }
+  auto response =
+      http ? http->get(url, conditions) : cpr::Get(cpr::Url{url}, conditions);
+  if (stats) {
+    stats->addResponse(response);
+  }
+  long long maxAge = 0;
+
+  if (cached && response.status_code == 304 &&
+      CacheDirectory::readFile(dataPath, body)) {
+    parseCacheControl(headerValue(response.header, "Cache-Control"), maxAge);
+    entry.freshUntil = now + maxAge;
+    writeEntry(entry);
+    CacheDirectory::touch(dataPath);
+    return true;
+  }
+  if (cached && response.status_code == 0 &&
+      CacheDirectory::readFile(dataPath, body)) {
+    // offline, a stale image beats no image
+    return true;
+  }
+  if (response.status_code == 304) {
+    // the cached body vanished under us, asking for the full one
+    response = http ? http->get(url) : cpr::Get(cpr::Url{url});
+    if (stats) {
+      stats->addResponse(response);
+    }
+  }
+  if (response.status_code != 200) {
+    std::cerr << "Failed to download image. Status: " << response.status_code
+              << std::endl;
+    return false;
+  }
+
+  body = std::move(response.text);
+  if (parseCacheControl(headerValue(response.header, "Cache-Control"),
+                        maxAge)) {
+    Entry fresh;
+    fresh.url = url;
+    fresh.etag = headerValue(response.header, "ETag");
+    fresh.lastModified = headerValue(response.header, "Last-Modified");
+    fresh.freshUntil = now + maxAge;
+    store(fresh, body);
+  }
+  return true;
+}
@@ -0,0 +1,59 @@
+#ifndef IMAGE_CACHE_HPP
+#define IMAGE_CACHE_HPP
+
+#include "CacheDirectory.hpp"
+#include "Stats.hpp"
+#include <cstdint>
+#include <string>
+
+class HttpClient;
+
+/**
+ * @class ImageCache
+ * @brief On-disk cache of downloaded images, keyed by a hash of the URL.
+ *
+ * Entries are served without any request while the server's max-age says
+ * they are fresh, and revalidated with If-None-Match / If-Modified-Since
+ * afterwards, so an unchanged image costs a 304 instead of the whole body.
+ * The directory is kept under a size limit by evicting the least recently
+ * used files, recency being each file's modification time.
+ */
+class ImageCache {
+public:
+  static constexpr uint64_t DEFAULT_MAX_BYTES = 256ull * 1024 * 1024;
+
+  explicit ImageCache(std::string directory,
+                      uint64_t maxBytes = DEFAULT_MAX_BYTES);
+
+  // $XDG_CACHE_HOME/waifu-fetch, or ~/.cache/waifu-fetch
+  static std::string defaultDirectory();
+
+  // fills `body` with the image at `url`, from disk when possible; false
+  // (with a message on stderr) when it can neither be fetched nor served
+  bool fetch(const std::string &url, std::string &body);
+
+  // records every request made into `stats` (not owned, may be null)
+  void setStats(Stats *stats) { this->stats = stats; }
+  // sends requests through `http` (not owned, may be null)
+  void setHttpClient(HttpClient *http) { this->http = http; }
+
+private:
+  struct Entry {
+    std::string url;
+    std::string etag;
+    std::string lastModified;
+    // unix time until which the entry is used without revalidation
+    long long freshUntil = 0;
+  };
+
+  CacheDirectory files;
+  Stats *stats = nullptr;
+  HttpClient *http = nullptr;
+
+  std::string pathFor(const std::string &url, const char *extension) const;
+  bool readEntry(const std::string &url, Entry &entry) const;
+  bool store(const Entry &entry, const std::string &body);
+  bool writeEntry(const Entry &entry);
+};
+
+#endif // IMAGE_CACHE_HPP
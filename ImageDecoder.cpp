@@ -0,0 +1,133 @@
+#include "ImageDecoder.hpp"
+#include <utility>
+
+namespace {
+
+// like browsers, treating near-zero delays as the historical GIF default
+constexpr int MIN_FRAME_MS = 20;
+constexpr int DEFAULT_FRAME_MS = 100;
+
+inline int readU16(const uchar *p) { return (p[0] << 8) | p[1]; }
+
+bool isStartOfFrame(uchar marker) {
+  // SOF0-SOF15, minus DHT (C4), JPG (C8) and DAC (CC)
+  return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+         marker != 0xC8 && marker != 0xCC;
+}
+
+} // namespace
+
+bool ImageDecoder::readJpegHeader(const uchar *data, size_t size,
+                                  Header &header) {
+  if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+    return false;
+  }
+
+  size_t pos = 2;
+  while (pos + 4 <= size) {
+    if (data[pos] != 0xFF) {
+      return false;
+    }
+    uchar marker = data[pos + 1];
+    if (marker == 0xFF) {
+      // fill byte before the actual marker
+      pos++;
+      continue;
+    }
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+      // standalone markers without a length field
+      pos += 2;
+      continue;
+    }
+
+    int length = readU16(data + pos + 2);
+    if (isStartOfFrame(marker)) {
+      if (pos + 9 > size) {
+        return false;
+      }
+      header.height = readU16(data + pos + 5);
+      header.width = readU16(data + pos + 7);
+      return header.width > 0 && header.height > 0;
+    }
+    if (marker == 0xDA || length < 2) {
+      // entropy-coded data starts, no frame header before it
+      return false;
+    }
+    pos += 2 + length;
+  }
+  return false;
+}
+
+cv::Mat ImageDecoder::decode(const uchar *data, size_t size, int minCols,
+                             int minRows, cv::Mat *dst) {
+  int flags = cv::IMREAD_COLOR;
+
+  Header header;
+  if (readJpegHeader(data, size, header)) {
+    static const int reducedFlags[] = {cv::IMREAD_REDUCED_COLOR_8,
+                                       cv::IMREAD_REDUCED_COLOR_4,
+                                       cv::IMREAD_REDUCED_COLOR_2};
+    static const int reducedScales[] = {8, 4, 2};
+    for (int i = 0; i < 3; i++) {
+      int scale = reducedScales[i];
+      if (header.width / scale >= minCols &&
+          header.height / scale >= minRows) {
+        flags = reducedFlags[i];
+        break;
+      }
+    }
+  }
+
+  // non-owning header over the caller's buffer
+  const cv::Mat encoded(1, static_cast<int>(size), CV_8UC1,
+                        const_cast<uchar *>(data));
+  return cv::imdecode(encoded, flags, dst);
+}
+
+bool ImageDecoder::decodeAnimation(const uchar *data, size_t size,
+                                   Animation &animation) {
+  animation = Animation();
+  const cv::Mat encoded(1, static_cast<int>(size), CV_8UC1,
+                        const_cast<uchar *>(data));
+
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 12)
+  cv::Animation decoded;
+  try {
+    if (cv::imdecodeanimation(encoded, decoded) && !decoded.frames.empty()) {
+      animation.frames = std::move(decoded.frames);
+      animation.durations = std::move(decoded.durations);
+      animation.loopCount = decoded.loop_count;
+    }
+  } catch (const cv::Exception &) {
+    // not an animation OpenCV can read, trying the other decoders
+  }
+#endif
+  if (animation.frames.empty()) {
+    try {
+      cv::imdecodemulti(encoded, cv::IMREAD_COLOR, animation.frames);
+    } catch (const cv::Exception &) {
+      animation.frames.clear();
+    }
+  }
+  if (animation.frames.empty()) {
+    cv::Mat still = cv::imdecode(encoded, cv::IMREAD_COLOR);
+    if (still.empty()) {
+      return false;
+    }
+    animation.frames.push_back(still);
+  }
+
+  animation.durations.resize(animation.frames.size(), DEFAULT_FRAME_MS);
+  for (size_t i = 0; i < animation.frames.size(); i++) {
+    cv::Mat &frame = animation.frames[i];
+    if (frame.channels() == 4) {
+      cv::cvtColor(frame, frame, cv::COLOR_BGRA2BGR);
+    } else if (frame.channels() == 1) {
+      cv::cvtColor(frame, frame, cv::COLOR_GRAY2BGR);
+    }
+    if (animation.durations[i] < MIN_FRAME_MS) {
+      animation.durations[i] = DEFAULT_FRAME_MS;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,47 @@
+#ifndef IMAGE_DECODER_HPP
+#define IMAGE_DECODER_HPP
+
+#include <cstddef>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+/**
+ * @class ImageDecoder
+ * @brief Decodes downloaded images at the smallest resolution the output
+ * grid can still use.
+ *
+ * JPEG headers are parsed up front so libjpeg can scale by 1/2, 1/4 or 1/8
+ * in the DCT domain, which is far cheaper in both time and memory than
+ * decoding a 4K image only to average it down to a few thousand cells.
+ */
+class ImageDecoder {
+public:
+  struct Header {
+    int width = 0;
+    int height = 0;
+  };
+
+  struct Animation {
+    std::vector<cv::Mat> frames;
+    // display time of each frame in milliseconds
+    std::vector<int> durations;
+    // how often the container asks to play it, 0 meaning forever
+    int loopCount = 0;
+  };
+
+  // reads the dimensions from a JPEG's SOF marker, false for other formats
+  static bool readJpegHeader(const uchar *data, size_t size, Header &header);
+
+  // decodes as 8-bit BGR with at least minCols x minRows pixels when the
+  // source is that large; the encoded bytes are read in place, not copied,
+  // and `dst` is reused when it already has the decoded size
+  static cv::Mat decode(const uchar *data, size_t size, int minCols,
+                        int minRows, cv::Mat *dst = nullptr);
+
+  // decodes every frame of an animated GIF, WebP or PNG as 8-bit BGR; still
+  // images come back as a single frame
+  static bool decodeAnimation(const uchar *data, size_t size,
+                              Animation &animation);
+};
+
+#endif // IMAGE_DECODER_HPP
@@ -1,10 +1,19 @@
 #include "ImageRenderer.hpp"
-#include <cmath>
+#include "FrameBuffer.hpp"
+#include "GlyphTable.hpp"
+#include "HttpClient.hpp"
+#include "ImageDecoder.hpp"
+#include "InlineImageEncoder.hpp"
+#include "Palette.hpp"
+#include "SgrWriter.hpp"
+#include <algorithm>
+#include <chrono>
 #include <cpr/cpr.h>
-#include <cstdio>
+#include <filesystem>
 #include <iostream>
-#include <limits>
-#include <sys/types.h>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 const std::string ImageRenderer::ASCII_CHARS_SIMPLE = " .:-=+*#%@";
@@ -13,6 +22,13 @@ const std::string ImageRenderer::ASCII_CHARS_DETAILED =
     "tfjrxnuvczXYUJCLQ0OZmwqpdbkhao*#MW&8%B@$";
 const std::string ImageRenderer::ASCII_CHARS_BLOCKS =
     " \u2591\u2592\u2593\u2588";
+// indexed by a mask of lit pixels: bit 0 top, bit 1 bottom
+const std::string ImageRenderer::ASCII_CHARS_HALF_BLOCKS =
+    " \u2580\u2584\u2588";
+// bit 0 top-left, bit 1 top-right, bit 2 bottom-left, bit 3 bottom-right
+const std::string ImageRenderer::ASCII_CHARS_QUARTER_BLOCKS =
+    " \u2598\u259D\u2580\u2596\u258C\u259E\u259B"
+    "\u2597\u259A\u2590\u259C\u2584\u2599\u259F\u2588";
 
 bool ImageRenderer::urlToAscii(const std::string &imgUrl) {
   return urlToAscii(imgUrl, ImageRenderer::RenderOptions{});
@@ -20,61 +36,545 @@ bool ImageRenderer::urlToAscii(const std::string &imgUrl) {
 
 bool ImageRenderer::urlToAscii(const std::string &imgUrl,
                                const ImageRenderer::RenderOptions &options) {
-  auto response = cpr::Get(cpr::Url{imgUrl});
+  StdoutSink sink;
+  return urlToAscii(imgUrl, options, sink);
+}
+
+bool ImageRenderer::urlToImage(const std::string &imgUrl,
+                               const ImageRenderer::RenderOptions &options) {
+  StdoutSink sink;
+  return urlToImage(imgUrl, options, sink);
+}
+
+bool ImageRenderer::urlToAscii(const std::string &imgUrl,
+                               const ImageRenderer::RenderOptions &options,
+                               FrameSink &sink) {
+  if (options.animate) {
+    return playAnimation(imgUrl, options, sink);
+  }
+  if (options.progressive) {
+    return streamToAscii(imgUrl, options, sink);
+  }
+
+  if (!download(imgUrl, downloaded)) {
+    return false;
+  }
+
+  // an image shown before with the same options is written out as is
+  uint64_t key = 0;
+  if (frameCache) {
+    key = frameKey(downloaded, options);
+    FrameCache::Mapping cached;
+    if (frameCache->lookup(key, cached)) {
+      Stats::Timer timer(stats, Stats::EMIT);
+      if (stats) {
+        stats->addEmitted(cached.size());
+      }
+      return sink.write(cached.data(), cached.size());
+    }
+  }
+
+  cv::Size minSize = minDecodeSize(options);
+  cv::Mat img = decodeDownloaded(minSize.width, minSize.height);
+  if (img.empty()) {
+    return false;
+  }
+
+  frame.clear();
+  renderImage(img, options, frame);
+  if (frameCache) {
+    frameCache->store(key, frame.data(), frame.size());
+  }
+  return emitFrame(sink);
+}
+
+bool ImageRenderer::urlToImage(const std::string &imgUrl,
+                               const ImageRenderer::RenderOptions &options,
+                               FrameSink &sink) {
+  InlineImageEncoder::Protocol protocol =
+      options.imageProtocol == InlineImageEncoder::AUTO
+          ? InlineImageEncoder::detect()
+          : options.imageProtocol;
+  if (protocol == InlineImageEncoder::NONE) {
+    // half blocks in color come closest where there are no pixels
+    RenderOptions cells = options;
+    cells.style = HALF_BLOCKS;
+    cells.colorSupport = true;
+    return urlToAscii(imgUrl, cells, sink);
+  }
+
+  cv::Size cell(options.cellWidth, options.cellHeight);
+  if (cell.width <= 0 || cell.height <= 0) {
+    InlineImageEncoder::cellSize(cell.width, cell.height);
+  }
+  // decoding at no less than the displayed size in pixels, since the
+  // terminal shows these pixels as they are
+  cv::Mat img = fetchImage(imgUrl, options.width * cell.width,
+                           options.height * cell.height);
+  if (img.empty()) {
+    return false;
+  }
+
+  frame.clear();
+  bool encoded;
+  {
+    Stats::Timer timer(stats, Stats::MAP);
+    encoded = InlineImageEncoder::encode(img, protocol, options.width,
+                                         options.height, cell, frame);
+  }
+  if (!encoded) {
+    std::cerr << "Failed to encode image" << std::endl;
+    return false;
+  }
+  return emitFrame(sink);
+}
+
+bool ImageRenderer::renderFile(const std::string &path,
+                               const ImageRenderer::RenderOptions &options,
+                               FrameSink &sink) {
+  if (!CacheDirectory::readFile(path, downloaded)) {
+    std::cerr << "Failed to read " << path << std::endl;
+    return false;
+  }
+  cv::Size minSize = minDecodeSize(options);
+  return renderMat(decodeDownloaded(minSize.width, minSize.height), options,
+                   sink);
+}
+
+bool ImageRenderer::renderMat(const cv::Mat &img,
+                              const ImageRenderer::RenderOptions &options,
+                              FrameSink &sink) {
+  if (img.empty()) {
+    return false;
+  }
+  frame.clear();
+  renderImage(img, options, frame);
+  return emitFrame(sink);
+}
+
+std::string_view
+ImageRenderer::renderToBuffer(const cv::Mat &img,
+                              const ImageRenderer::RenderOptions &options) {
+  frame.clear();
+  if (!img.empty()) {
+    renderImage(img, options, frame);
+  }
+  return std::string_view(frame.data(), frame.size());
+}
+
+bool ImageRenderer::download(const std::string &imgUrl, std::string &body) {
+  Stats::Timer timer(stats, Stats::DOWNLOAD);
+  if (cache) {
+    return cache->fetch(imgUrl, body);
+  }
+
+  auto response = http ? http->get(imgUrl) : cpr::Get(cpr::Url{imgUrl});
+  if (stats) {
+    stats->addResponse(response);
+  }
   if (response.status_code != 200) {
     std::cerr << "Failed to download image. Status: " << response.status_code
               << std::endl;
     return false;
   }
-  // decoding image
-  std::vector<uchar> imgData(response.text.begin(), response.text.end());
-  cv::Mat img = cv::imdecode(imgData, cv::IMREAD_COLOR);
+  body = std::move(response.text);
+  return true;
+}
 
+cv::Mat ImageRenderer::fetchImage(const std::string &imgUrl, int minCols,
+                                  int minRows) {
+  if (!download(imgUrl, downloaded)) {
+    return cv::Mat();
+  }
+  return decodeDownloaded(minCols, minRows);
+}
+
+cv::Mat ImageRenderer::decodeDownloaded(int minCols, int minRows) {
+  Stats::Timer timer(stats, Stats::DECODE);
+  // decoding image straight from the downloaded body, at reduced resolution
+  // when the target is much smaller
+  cv::Mat img = ImageDecoder::decode(
+      reinterpret_cast<const uchar *>(downloaded.data()), downloaded.size(),
+      minCols, minRows, &decoded);
   if (img.empty()) {
     std::cerr << "Failed to decode image" << std::endl;
+  }
+  return img;
+}
+
+uint64_t ImageRenderer::frameKey(const std::string &imageBytes,
+                                 const ImageRenderer::RenderOptions &options) {
+  return CacheDirectory::hash(imageBytes.data(), imageBytes.size(),
+                              optionsKey(options));
+}
+
+uint64_t
+ImageRenderer::optionsKey(const ImageRenderer::RenderOptions &options) {
+  // everything that changes the frame's bytes; threads and the fetch modes
+  // do not
+  uint64_t key =
+      CacheDirectory::hash(&FRAME_CACHE_VERSION, sizeof(FRAME_CACHE_VERSION));
+  const int fields[] = {options.width,
+                        options.height,
+                        options.style,
+                        options.colorSupport,
+                        options.aspectRatio,
+                        options.usePallete,
+                        options.colorTolerance,
+                        options.colorMode};
+  key = CacheDirectory::hash(fields, sizeof(fields), key);
+  const double adjustments[] = {options.contrast, options.brightness};
+  key = CacheDirectory::hash(adjustments, sizeof(adjustments), key);
+
+  // the colors rather than the file name, so editing the palette file
+  // invalidates the frames made with it
+  if (!options.paletteFile.empty() && selectPalette(options) &&
+      customPalette) {
+    for (size_t i = 0; i < customPalette->size(); i++) {
+      const Palette::Color &color = (*customPalette)[i];
+      const uint8_t rgb[] = {color.r, color.g, color.b};
+      key = CacheDirectory::hash(rgb, sizeof(rgb), key);
+    }
+  }
+  return key;
+}
+
+bool ImageRenderer::streamToAscii(const std::string &imgUrl,
+                                  const ImageRenderer::RenderOptions &options,
+                                  FrameSink &sink) {
+  std::string body;
+  size_t nextPreview = PREVIEW_FIRST_BYTES;
+  auto lastPreview = std::chrono::steady_clock::now();
+  int shownRows = 0;
+
+  // redraws the frame over whatever preview was shown before, clearing any
+  // rows the previous one had in excess
+  auto show = [&](const cv::Mat &img) {
+    frame.clear();
+    if (shownRows > 0) {
+      frame.append("\x1b[");
+      frame.appendUInt(shownRows);
+      frame.append("A\r\x1b[J");
+    }
+    shownRows = renderImage(img, options, frame);
+    return emitFrame(sink);
+  };
+
+  auto onData = [&](const std::string_view &data, intptr_t) {
+    body.append(data.data(), data.size());
+
+    auto now = std::chrono::steady_clock::now();
+    if (body.size() < nextPreview || now - lastPreview < PREVIEW_INTERVAL) {
+      return true;
+    }
+
+    // libjpeg decodes a truncated stream up to the last complete scanline
+    // (or progressive scan), other formats just fail until complete
+    ImageDecoder::Header header;
+    const uchar *bytes = reinterpret_cast<const uchar *>(body.data());
+    if (ImageDecoder::readJpegHeader(bytes, body.size(), header)) {
+      try {
+        cv::Size minSize = minDecodeSize(options);
+        cv::Mat preview;
+        {
+          Stats::Timer timer(stats, Stats::DECODE);
+          preview = ImageDecoder::decode(
+              bytes, body.size(), minSize.width / MIN_SAMPLES_PER_CELL,
+              minSize.height / MIN_SAMPLES_PER_CELL, &decoded);
+        }
+        if (!preview.empty()) {
+          show(preview);
+        }
+      } catch (const cv::Exception &) {
+        // not enough data yet, the next chunk gets another try
+      }
+    }
+
+    // doubling the threshold keeps the total re-decode work linear
+    nextPreview = body.size() * 2;
+    lastPreview = now;
+    return true;
+  };
+
+  // the transfer overlaps with rendering the previews, so only curl's own
+  // timing of it is recorded
+  auto response =
+      http ? http->get(imgUrl, cpr::WriteCallback{onData})
+           : cpr::Get(cpr::Url{imgUrl}, cpr::WriteCallback{onData});
+  if (stats) {
+    stats->addResponse(response);
+  }
+  if (response.status_code != 200) {
+    std::cerr << "Failed to download image. Status: " << response.status_code
+              << std::endl;
+    return false;
+  }
+
+  cv::Size minSize = minDecodeSize(options);
+  cv::Mat img;
+  {
+    Stats::Timer timer(stats, Stats::DECODE);
+    img = ImageDecoder::decode(reinterpret_cast<const uchar *>(body.data()),
+                               body.size(), minSize.width, minSize.height,
+                               &decoded);
+  }
+  if (img.empty()) {
+    std::cerr << "Failed to decode image" << std::endl;
+    return false;
+  }
+
+  return show(img);
+}
+
+bool ImageRenderer::playAnimation(const std::string &imgUrl,
+                                  const ImageRenderer::RenderOptions &options,
+                                  FrameSink &sink) {
+  if (!download(imgUrl, downloaded)) {
     return false;
   }
 
-  renderImage(img, options);
+  ImageDecoder::Animation animation;
+  bool decodedAll;
+  {
+    Stats::Timer timer(stats, Stats::DECODE);
+    decodedAll = ImageDecoder::decodeAnimation(
+        reinterpret_cast<const uchar *>(downloaded.data()), downloaded.size(),
+        animation);
+  }
+  if (!decodedAll) {
+    std::cerr << "Failed to decode image" << std::endl;
+    return false;
+  }
+
+  // the grid is fixed by the first frame and each frame is sampled down to
+  // it right away, so playback holds no full-resolution frames; sampling
+  // those pixels again at one per sample leaves them as they are
+  RenderOptions playback = options;
+  const cv::Size grid = gridSize(animation.frames[0], options);
+  playback.width = grid.width;
+  playback.height = grid.height;
+  playback.aspectRatio = false;
+  {
+    Stats::Timer timer(stats, Stats::PREPROCESS);
+    int sx, sy;
+    samplesPerCell(options.style, sx, sy);
+    const int rows = grid.height * sy;
+    const int cols = grid.width * sx;
+    cv::Mat luma = planeView(lumaStorage, rows, cols, CV_8UC1, 1);
+    CellSampler sampler;
+    for (cv::Mat &decodedFrame : animation.frames) {
+      if (decodedFrame.total() <= static_cast<size_t>(rows) * cols) {
+        continue;
+      }
+      cv::Mat sampled(rows, cols, CV_8UC3);
+      sampler.sample(decodedFrame, 1.0, 0.0, sampled, luma, 0, rows);
+      decodedFrame = sampled;
+    }
+  }
+
+  const int loops = options.loops > 0 ? options.loops : animation.loopCount;
+  shownCells = CellGrid();
+  auto deadline = std::chrono::steady_clock::now();
+
+  for (int loop = 0; loops == 0 || loop < loops; loop++) {
+    for (size_t i = 0; i < animation.frames.size(); i++) {
+      renderImage(animation.frames[i], playback, nextCells);
+
+      // an empty grid on screen makes the first frame a full draw
+      frame.clear();
+      nextCells.appendDiff(shownCells, frame);
+      std::swap(shownCells, nextCells);
+
+      std::this_thread::sleep_until(deadline);
+      if (!emitFrame(sink)) {
+        return false;
+      }
+      deadline += std::chrono::milliseconds(animation.durations[i]);
+    }
+    if (animation.frames.size() == 1) {
+      break;
+    }
+  }
   return true;
 }
 
-const std::string &
-ImageRenderer::getCharSet(ImageRenderer::CharStyle style) const {
+const GlyphTable &
+ImageRenderer::getGlyphTable(ImageRenderer::CharStyle style) const {
+  // built once per style and shared by every renderer
+  static const GlyphTable simple(ASCII_CHARS_SIMPLE);
+  static const GlyphTable detailed(ASCII_CHARS_DETAILED);
+  static const GlyphTable blocks(ASCII_CHARS_BLOCKS);
+  static const GlyphTable halfBlocks(ASCII_CHARS_HALF_BLOCKS);
+  static const GlyphTable quarterBlocks(ASCII_CHARS_QUARTER_BLOCKS);
+  // U+2800 + dot mask, every pattern is a 3-byte UTF-8 sequence
+  static const GlyphTable braille([] {
+    std::string patterns;
+    for (int mask = 0; mask < 256; mask++) {
+      int codepoint = 0x2800 + mask;
+      patterns += static_cast<char>(0xE0 | (codepoint >> 12));
+      patterns += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+      patterns += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+    return patterns;
+  }());
+
   switch (style) {
-  case ImageRenderer::SIMPLE:
-    return ASCII_CHARS_SIMPLE;
   case DETAILED:
-    return ASCII_CHARS_DETAILED;
+    return detailed;
   case BLOCKS:
-    return ASCII_CHARS_BLOCKS;
+    return blocks;
+  case HALF_BLOCKS:
+    return halfBlocks;
+  case QUARTER_BLOCKS:
+    return quarterBlocks;
+  case BRAILLE:
+    return braille;
+  default:
+    return simple;
+  }
+}
+
+void ImageRenderer::samplesPerCell(ImageRenderer::CharStyle style, int &sx,
+                                   int &sy) {
+  switch (style) {
+  case HALF_BLOCKS:
+    sx = 1;
+    sy = 2;
+    break;
+  case QUARTER_BLOCKS:
+    sx = 2;
+    sy = 2;
+    break;
+  case BRAILLE:
+    sx = 2;
+    sy = 4;
+    break;
   default:
-    return ASCII_CHARS_SIMPLE;
+    sx = 1;
+    sy = 1;
+    break;
   }
 }
 
-std::vector<std::string>
-ImageRenderer::splitCharSet(const std::string &charSet) {
-  std::vector<std::string> chars;
-  if (charSet == getCharSet(BLOCKS)) {
-    chars = {" ", "░", "▒", "▓", "█"};
-  } else if (charSet == getCharSet(SIMPLE)) {
-    chars = {" ", ".", ":", "-", "=", "+", "*", "#", "%", "@"};
+bool ImageRenderer::parseStyle(const std::string &name,
+                               ImageRenderer::CharStyle &style) {
+  static const std::pair<const char *, CharStyle> styles[] = {
+      {"simple", SIMPLE},           {"detailed", DETAILED},
+      {"blocks", BLOCKS},           {"half", HALF_BLOCKS},
+      {"quarter", QUARTER_BLOCKS}, {"braille", BRAILLE}};
+  for (const auto &entry : styles) {
+    if (name == entry.first) {
+      style = entry.second;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ImageRenderer::parseColorMode(const std::string &name,
+                                   ImageRenderer::ColorMode &mode) {
+  if (name == "truecolor") {
+    mode = TRUECOLOR;
+  } else if (name == "256") {
+    mode = XTERM_256;
+  } else if (name == "16") {
+    mode = ANSI_16;
   } else {
-    for (char c : charSet) {
-      chars.push_back(std::string(1, c));
+    return false;
+  }
+  return true;
+}
+
+cv::Size ImageRenderer::minDecodeSize(
+    const ImageRenderer::RenderOptions &options) const {
+  int sx, sy;
+  samplesPerCell(options.style, sx, sy);
+  return cv::Size(options.width * sx * MIN_SAMPLES_PER_CELL,
+                  options.height * sy * MIN_SAMPLES_PER_CELL);
+}
+
+const Palette *
+ImageRenderer::selectPalette(const ImageRenderer::RenderOptions &options) {
+  if (!options.paletteFile.empty()) {
+    // reloaded when the file changes, the daemon and the service live long
+    std::error_code ec;
+    auto modified = std::filesystem::last_write_time(options.paletteFile, ec);
+    if (customPalettePath != options.paletteFile ||
+        (!ec && modified != customPaletteTime)) {
+      customPalette = Palette::fromFile(options.paletteFile);
+      // a file that failed to load is retried, and reported, next frame
+      customPalettePath = customPalette ? options.paletteFile : std::string();
+      customPaletteTime = modified;
+    }
+    if (customPalette) {
+      return customPalette.get();
+    }
+  }
+
+  if (options.usePallete) {
+    return &Palette::anime();
+  }
+  switch (options.colorMode) {
+  case XTERM_256:
+    return &Palette::xterm256();
+  case ANSI_16:
+    return &Palette::ansi16();
+  default:
+    return nullptr;
+  }
+}
+
+bool ImageRenderer::emitFrame(FrameSink &sink) {
+  Stats::Timer timer(stats, Stats::EMIT);
+  if (stats) {
+    stats->addEmitted(frame.size());
+  }
+  // emitting the whole frame with one write so the terminal never sees a
+  // partially drawn image
+  return frame.writeTo(sink);
+}
+
+void ImageRenderer::reserve(int maxWidth, int maxHeight, int threads) {
+  // braille packs the most samples into a cell, 2x4
+  const size_t samples = static_cast<size_t>(maxWidth) * 2 * maxHeight * 4;
+  if (sampleStorage.size() < samples * 3) {
+    sampleStorage.resize(samples * 3);
+  }
+  if (lumaStorage.size() < samples) {
+    lumaStorage.resize(samples);
+  }
+
+  // worst case per cell: two 24-bit color escapes and a 3-byte glyph
+  const size_t frameBytes =
+      static_cast<size_t>(maxHeight) * (maxWidth * 41 + 5);
+  frame.reserve(frameBytes);
+
+  threads = std::max(1, threads);
+  if (bands.size() < static_cast<size_t>(threads)) {
+    bands.resize(threads);
+  }
+  workers.reserve(threads);
+  for (Band &band : bands) {
+    band.sampler.reserve(maxWidth * 2);
+    band.paletteIndices.reserve(maxWidth);
+    if (threads > 1) {
+      band.frame.reserve(frameBytes / threads + maxWidth * 41 + 5);
     }
   }
-  return chars;
 }
 
-void ImageRenderer::renderImage(cv::Mat &img,
-                                const ImageRenderer::RenderOptions &options) {
-  // adjusting color and brightness
-  if (options.contrast != 1.0 || options.brightness != 0.0) {
-    img.convertTo(img, -1, options.contrast, options.brightness);
+cv::Mat ImageRenderer::planeView(std::vector<uchar> &storage, int rows,
+                                 int cols, int type, int channels) {
+  const size_t bytes = static_cast<size_t>(rows) * cols * channels;
+  if (storage.size() < bytes) {
+    storage.resize(bytes);
   }
+  return cv::Mat(rows, cols, type, storage.data());
+}
 
+cv::Size
+ImageRenderer::gridSize(const cv::Mat &img,
+                        const ImageRenderer::RenderOptions &options) const {
   int target_width = options.width;
   int target_height = options.height;
 
@@ -91,100 +591,286 @@ void ImageRenderer::renderImage(cv::Mat &img,
     target_width = std::max(target_width, 20);
     target_height = std::max(target_height, 20);
   }
+  return cv::Size(target_width, target_height);
+}
 
-  // resizing img
-  cv::resize(img, img, cv::Size(target_width, target_height));
+template <typename Target>
+int ImageRenderer::renderImage(const cv::Mat &img,
+                               const ImageRenderer::RenderOptions &options,
+                               Target &out) {
+  const cv::Size grid = gridSize(img, options);
+  const int target_width = grid.width;
+  const int target_height = grid.height;
+  if constexpr (std::is_same_v<Target, CellGrid>) {
+    out.resize(target_width, target_height);
+  }
+
+  // the sampler resizes, adjusts contrast and derives the grayscale plane
+  // in one pass over the source, at one sample per packed pixel
+  int sx, sy;
+  samplesPerCell(options.style, sx, sy);
+  cv::Mat cells = planeView(sampleStorage, target_height * sy,
+                            target_width * sx, CV_8UC3, 3);
+  cv::Mat gray = planeView(lumaStorage, target_height * sy, target_width * sx,
+                           CV_8UC1, 1);
 
-  const std::string &charSet = getCharSet(options.style);
+  const GlyphTable &glyphs = getGlyphTable(options.style);
+  ColorMapping colors;
   if (options.colorSupport) {
-    renderColorAscii(img, charSet, options.usePallete);
+    colors = prepareColorMapping(options);
+  }
+
+  auto renderRows = [&](int rowBegin, int rowEnd, auto &out, Band &scratch) {
+    {
+      Stats::Timer timer(stats, Stats::PREPROCESS);
+      scratch.sampler.sample(img, options.contrast, options.brightness, cells,
+                             gray, rowBegin * sy, rowEnd * sy);
+    }
+    Stats::Timer timer(stats, Stats::MAP);
+    if (sx > 1 || sy > 1) {
+      renderBlockCells(cells, gray, rowBegin, rowEnd, glyphs, colors, options,
+                       out);
+    } else if (options.colorSupport) {
+      renderColorAscii(cells, gray, rowBegin, rowEnd, glyphs, colors, options,
+                       out, scratch.paletteIndices);
+    } else {
+      renderGrayScaleAscii(gray, rowBegin, rowEnd, glyphs, out);
+    }
+  };
+
+  int threads = options.threads > 0
+                    ? options.threads
+                    : static_cast<int>(std::thread::hardware_concurrency());
+  // bands of only a few rows cost more to spawn than to map
+  threads = std::max(1, std::min(threads, target_height / MIN_BAND_ROWS));
+  if (bands.size() < static_cast<size_t>(threads)) {
+    bands.resize(threads);
+  }
+
+  if constexpr (std::is_same_v<Target, CellGrid>) {
+    // bands own disjoint rows of the grid, so they write into it directly
+    auto renderBand = [&](int rowBegin, int rowEnd, Band &scratch) {
+      CellGrid::Writer writer(out, rowBegin, options.colorTolerance);
+      renderRows(rowBegin, rowEnd, writer, scratch);
+    };
+    if (threads == 1) {
+      renderBand(0, target_height, bands[0]);
+    } else {
+      workers.clear();
+      for (int t = 0; t < threads; t++) {
+        int rowBegin = target_height * t / threads;
+        int rowEnd = target_height * (t + 1) / threads;
+        workers.emplace_back([&, t, rowBegin, rowEnd] {
+          renderBand(rowBegin, rowEnd, bands[t]);
+        });
+      }
+      for (std::thread &worker : workers) {
+        worker.join();
+      }
+    }
+  } else if (threads == 1) {
+    SgrWriter writer(out, options.colorTolerance);
+    renderRows(0, target_height, writer, bands[0]);
   } else {
-    renderGrayScaleAscii(img, charSet, options.usePallete);
+    workers.clear();
+    for (int t = 0; t < threads; t++) {
+      int rowBegin = target_height * t / threads;
+      int rowEnd = target_height * (t + 1) / threads;
+      workers.emplace_back([&, t, rowBegin, rowEnd] {
+        bands[t].frame.clear();
+        SgrWriter writer(bands[t].frame, options.colorTolerance);
+        renderRows(rowBegin, rowEnd, writer, bands[t]);
+      });
+    }
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+
+    // stitching the bands back together in order
+    for (int t = 0; t < threads; t++) {
+      out.append(bands[t].frame.data(), bands[t].frame.size());
+    }
+  }
+  return target_height;
+}
+
+template <typename Writer>
+void ImageRenderer::renderGrayScaleAscii(const cv::Mat &gray, int rowBegin,
+                                         int rowEnd, const GlyphTable &glyphs,
+                                         Writer &out) {
+  out.reserve(static_cast<size_t>(rowEnd - rowBegin) * (gray.cols * 4 + 1));
+  for (int i = rowBegin; i < rowEnd; i++) {
+    out.glyphRow(glyphs, gray.ptr<uchar>(i), gray.cols);
+    out.endLine();
   }
 }
 
-void ImageRenderer::renderGrayScaleAscii(const cv::Mat &img,
-                                         const std::string &charSet,
-                                         const bool &usePalette) {
-  cv::Mat gray;
-  cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+ImageRenderer::ColorMapping ImageRenderer::prepareColorMapping(
+    const ImageRenderer::RenderOptions &options) {
+  ColorMapping colors;
+  colors.palette = selectPalette(options);
 
-  auto chars = splitCharSet(charSet);
+  // terminal color number for every palette entry in the indexed modes
+  if (options.colorMode != TRUECOLOR) {
+    const bool xterm = options.colorMode == XTERM_256;
+    const Palette &target = xterm ? Palette::xterm256() : Palette::ansi16();
+    const Palette *palette = colors.palette;
+    const int offset = xterm ? 16 : 0;
+    for (size_t k = 0; k < palette->size(); k++) {
+      const Palette::Color &color = (*palette)[k];
+      size_t code =
+          palette == &target ? k : target.nearest(color.r, color.g, color.b);
+      colors.codes[k] = static_cast<uint8_t>(code + offset);
+    }
+  }
+  return colors;
+}
 
-  std::string line;
-  for (int i = 0; i < gray.rows; i++) {
-    line = "";
-    for (int j = 0; j < gray.cols; j++) {
-      int pixel = gray.at<uchar>(i, j);
-      int idx = pixel * (chars.size() - 1) / 255;
-      line += chars[idx];
+template <typename Writer>
+void ImageRenderer::setColor(Writer &sgr,
+                             const ImageRenderer::ColorMapping &colors,
+                             const ImageRenderer::RenderOptions &options,
+                             bool foreground, int r, int g, int b) const {
+  if (colors.palette) {
+    uint8_t index = colors.palette->nearest(r, g, b);
+    if (options.colorMode == XTERM_256) {
+      foreground ? sgr.foreground256(colors.codes[index])
+                 : sgr.background256(colors.codes[index]);
+      return;
+    }
+    if (options.colorMode == ANSI_16) {
+      foreground ? sgr.foreground16(colors.codes[index])
+                 : sgr.background16(colors.codes[index]);
+      return;
     }
-    std::cout << line << std::endl;
+    const Palette::Color &color = (*colors.palette)[index];
+    r = color.r;
+    g = color.g;
+    b = color.b;
   }
+  foreground ? sgr.foreground(r, g, b) : sgr.background(r, g, b);
 }
 
-void ImageRenderer::renderColorAscii(const cv::Mat &img,
-                                     const std::string &charSet,
-                                     const bool &usePalette) {
-  cv::Mat gray;
-  cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
-  auto chars = splitCharSet(charSet);
+template <typename Writer>
+void ImageRenderer::renderBlockCells(
+    const cv::Mat &samples, const cv::Mat &luma, int rowBegin, int rowEnd,
+    const GlyphTable &glyphs, const ImageRenderer::ColorMapping &colors,
+    const ImageRenderer::RenderOptions &options, Writer &sgr) {
+  int sx, sy;
+  samplesPerCell(options.style, sx, sy);
+  const int cols = samples.cols / sx;
+  const int count = sx * sy;
 
-  struct Color {
-    int r, g, b;
-  };
-  std::vector<Color> palette = {
-      {255, 218, 185}, // Peach (skin tone)
-      {255, 192, 203}, // Pink (hair)
-      {0, 128, 255},   // Sky Blue (eyes)
-      {0, 0, 0},       // Black (outlines)
-      {255, 215, 0},   // Gold (accents)
-      {255, 99, 71}    // Tomato (bold color)
-  };
+  // worst case per cell: two 24-bit color escapes and a 3-byte glyph
+  sgr.reserve(static_cast<size_t>(rowEnd - rowBegin) * (cols * 41 + 5));
 
-  for (int i = 0; i < img.rows; i++) {
-    for (int j = 0; j < img.cols; j++) {
-      cv::Vec3b pixel = img.at<cv::Vec3b>(i, j);
-      int b = pixel[0], g = pixel[1], r = pixel[2];
-
-      r = std::max(0, std::min(255, r));
-      g = std::max(0, std::min(255, g));
-      b = std::max(0, std::min(255, b));
-
-      int brightness = gray.at<uchar>(i, j);
-      int maxIdx = (int)chars.size() - 1;
-      int calcIdx = brightness * maxIdx / 255;
-      int idx = std::max(0, std::min(maxIdx, calcIdx));
-
-      if (usePalette) {
-        float minDist = std::numeric_limits<float>::max();
-        Color closestColor = palette[0];
-        for (const auto &color : palette) {
-          float dist =
-              std::sqrt(std::pow(r - color.r, 2) + std::pow(g - color.g, 2) +
-                        std::pow(b - color.b, 2));
-          if (dist < minDist) {
-            minDist = dist;
-            closestColor = color;
-          }
+  for (int y = rowBegin; y < rowEnd; y++) {
+    const uchar *colorRows[4];
+    const uchar *lumaRows[4];
+    for (int k = 0; k < sy; k++) {
+      colorRows[k] = samples.ptr<uchar>(y * sy + k);
+      lumaRows[k] = luma.ptr<uchar>(y * sy + k);
+    }
+
+    for (int x = 0; x < cols; x++) {
+      // gathering the cell's pixels; bit i of a mask is pixel i, row-major
+      // for the block styles and in dot order for braille
+      int level[8];
+      const uchar *pixel[8];
+      for (int k = 0; k < sy; k++) {
+        for (int c = 0; c < sx; c++) {
+          int i = options.style == BRAILLE ? (k < 3 ? c * 3 + k : 6 + c)
+                                           : k * sx + c;
+          level[i] = lumaRows[k][x * sx + c];
+          pixel[i] = colorRows[k] + (x * sx + c) * 3;
+        }
+      }
+
+      if (!options.colorSupport) {
+        int mask = 0;
+        for (int i = 0; i < count; i++) {
+          mask |= (level[i] >= 128) << i;
         }
-        r = closestColor.r;
-        g = closestColor.g;
-        b = closestColor.b;
+        sgr.glyph(glyphs.at(mask));
+        continue;
+      }
+
+      // splitting the cell into lit and unlit pixels around its mean
+      int mean = 0;
+      for (int i = 0; i < count; i++) {
+        mean += level[i];
       }
+      mean = (mean + count / 2) / count;
 
-      if (idx < chars.size() && !chars[idx].empty()) {
-        printf("\x1b[48;2;%d;%d;%dm%s\x1b[0m", r, g, b, chars[idx].c_str());
+      int mask = 0;
+      int on[3] = {0, 0, 0}, off[3] = {0, 0, 0};
+      int onCount = 0;
+      for (int i = 0; i < count; i++) {
+        bool lit = level[i] >= mean;
+        int *sum = lit ? on : off;
+        sum[0] += pixel[i][2];
+        sum[1] += pixel[i][1];
+        sum[2] += pixel[i][0];
+        mask |= lit << i;
+        onCount += lit;
+      }
+      const int offCount = count - onCount;
+
+      if (options.style == BRAILLE) {
+        // dots in the lit pixels' color over the terminal background
+        setColor(sgr, colors, options, true, on[0] / onCount,
+                 on[1] / onCount, on[2] / onCount);
+      } else if (offCount == 0) {
+        // a flat cell is just a background-colored space
+        setColor(sgr, colors, options, false, on[0] / count, on[1] / count,
+                 on[2] / count);
+        mask = 0;
       } else {
-        printf("\x1b[48;2;%d;%d;%dm \x1b[0m", r, g, b);
+        setColor(sgr, colors, options, true, on[0] / onCount,
+                 on[1] / onCount, on[2] / onCount);
+        setColor(sgr, colors, options, false, off[0] / offCount,
+                 off[1] / offCount, off[2] / offCount);
       }
+      sgr.glyph(glyphs.at(mask));
+    }
+    sgr.endLine();
+  }
+}
+
+template <typename Writer>
+void ImageRenderer::renderColorAscii(
+    const cv::Mat &img, const cv::Mat &gray, int rowBegin, int rowEnd,
+    const GlyphTable &glyphs, const ColorMapping &colors,
+    const ImageRenderer::RenderOptions &options, Writer &sgr,
+    std::vector<uint8_t> &indices) {
+  // worst case per cell: "\x1b[48;2;255;255;255m" + glyph + "\x1b[0m"
+  sgr.reserve(static_cast<size_t>(rowEnd - rowBegin) * (img.cols * 27 + 1));
+
+  const Palette *palette = colors.palette;
+  if (palette) {
+    indices.resize(img.cols);
+  }
+
+  for (int i = rowBegin; i < rowEnd; i++) {
+    const uchar *row = img.ptr<uchar>(i);
+    const uchar *levels = gray.ptr<uchar>(i);
+    if (palette) {
+      palette->quantize(row, img.cols, indices.data());
     }
-    printf("\n");
 
-    // flushing periodically to prevent buffering issues
-    if (i % 5 == 0) {
-      fflush(stdout);
+    for (int j = 0; j < img.cols; j++) {
+      if (options.colorMode == XTERM_256) {
+        sgr.background256(colors.codes[indices[j]]);
+      } else if (options.colorMode == ANSI_16) {
+        sgr.background16(colors.codes[indices[j]]);
+      } else if (palette) {
+        const Palette::Color &color = (*palette)[indices[j]];
+        sgr.background(color.r, color.g, color.b);
+      } else {
+        sgr.background(row[j * 3 + 2], row[j * 3 + 1], row[j * 3]);
+      }
+      sgr.glyph(glyphs.forLevel(levels[j]));
     }
+    sgr.endLine();
   }
-  fflush(stdout);
 }
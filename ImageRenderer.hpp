@@ -1,17 +1,46 @@
 #ifndef IMAGE_RENDERER_HPP
 #define IMAGE_RENDERER_HPP
 
+#include "CellGrid.hpp"
+#include "CellSampler.hpp"
+#include "FrameBuffer.hpp"
+#include "FrameCache.hpp"
+#include "FrameSink.hpp"
+#include "GlyphTable.hpp"
+#include "ImageCache.hpp"
+#include "InlineImageEncoder.hpp"
+#include "Palette.hpp"
+#include "SgrWriter.hpp"
+#include "Stats.hpp"
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <memory>
 #include <opencv2/opencv.hpp>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
+class HttpClient;
+
 /**
  * @class ImageRenderer
  * @brief Renders images as ASCII art in the terminal.
  */
 class ImageRenderer {
 public:
-  enum CharStyle { SIMPLE, DETAILED, BLOCKS };
+  // the *_BLOCKS and BRAILLE styles pack 2x1, 2x2 or 2x4 pixels into each
+  // cell using foreground + background colors (or dot patterns)
+  enum CharStyle {
+    SIMPLE,
+    DETAILED,
+    BLOCKS,
+    HALF_BLOCKS,
+    QUARTER_BLOCKS,
+    BRAILLE
+  };
+  enum ColorMode { TRUECOLOR, XTERM_256, ANSI_16 };
 
   struct RenderOptions {
     int width = 120;
@@ -22,23 +51,180 @@ public:
     double contrast = 1.0;
     double brightness = 0.0;
     bool usePallete = false;
+    // adjacent cells whose colors differ by at most this much per channel
+    // reuse the previous escape sequence instead of emitting a new one
+    int colorTolerance = 0;
+    // escape sequences used for colors; the indexed modes quantize to the
+    // terminal's own palette unless usePallete or paletteFile pick another
+    ColorMode colorMode = TRUECOLOR;
+    // custom palette, see Palette::fromFile for the format
+    std::string paletteFile;
+    // rows are mapped in this many parallel bands, 0 uses every core
+    int threads = 1;
+    // render coarse previews while the image is still downloading and
+    // refine them in place (JPEG only)
+    bool progressive = false;
+    // play animated GIF/WebP/PNG images in place, redrawing only the cells
+    // that change between frames
+    bool animate = false;
+    // times to play an animation, 0 repeats as often as the file says
+    int loops = 1;
+    // protocol used by urlToImage, picked from the environment by default
+    InlineImageEncoder::Protocol imageProtocol = InlineImageEncoder::AUTO;
+    // pixels per cell for urlToImage, 0 asks the terminal on stdout; set
+    // when rendering for another terminal, as the daemon does
+    int cellWidth = 0;
+    int cellHeight = 0;
   };
 
   bool urlToAscii(const std::string &imgUrl);
   bool urlToAscii(const std::string &imgUrl, const RenderOptions &options);
+  // shows the image with real pixels (sixel, kitty or iTerm2), sized to
+  // fit in options.width x options.height cells; terminals without any of
+  // them get colored half blocks instead
+  bool urlToImage(const std::string &imgUrl, const RenderOptions &options);
+
+  // same as above, writing each finished frame to `sink` instead of stdout
+  bool urlToAscii(const std::string &imgUrl, const RenderOptions &options,
+                  FrameSink &sink);
+  bool urlToImage(const std::string &imgUrl, const RenderOptions &options,
+                  FrameSink &sink);
+  // renders the image file at `path`, decoded at reduced resolution when
+  // the grid is much smaller
+  bool renderFile(const std::string &path, const RenderOptions &options,
+                  FrameSink &sink);
+  // a hash of everything in `options` that changes the frame's bytes,
+  // including the colors of a custom palette
+  uint64_t optionsKey(const RenderOptions &options);
+  // renders an already decoded 8-bit BGR image
+  bool renderMat(const cv::Mat &img, const RenderOptions &options,
+                 FrameSink &sink);
+  // renders into the renderer's own frame buffer without any I/O; the view
+  // stays valid until the next call on this renderer
+  std::string_view renderToBuffer(const cv::Mat &img,
+                                  const RenderOptions &options);
+
+  // serves downloads through `cache` (not owned, may be null); progressive
+  // mode keeps streaming from the network
+  void setCache(ImageCache *cache) { this->cache = cache; }
+  // reuses finished frames from `frameCache` (not owned, may be null) when
+  // the same image is shown again with the same options
+  void setFrameCache(FrameCache *frameCache) {
+    this->frameCache = frameCache;
+  }
+  // records stage timings and byte counts into `stats` (not owned, may be
+  // null)
+  void setStats(Stats *stats) { this->stats = stats; }
+  // sends requests through `http` (not owned, may be null) to reuse its
+  // connections; without one every request sets up its own
+  void setHttpClient(HttpClient *http) { this->http = http; }
+
+  // pixels packed into one cell horizontally and vertically
+  static void samplesPerCell(CharStyle style, int &sx, int &sy);
+
+  // parse the names used on the command line and in service queries:
+  // simple|detailed|blocks|half|quarter|braille and truecolor|256|16
+  static bool parseStyle(const std::string &name, CharStyle &style);
+  static bool parseColorMode(const std::string &name, ColorMode &mode);
+
+  // pre-sizes the scratch buffers for grids up to maxWidth x maxHeight cells
+  // rendered with up to `threads` bands; buffers otherwise grow on demand
+  // and are kept across calls, so steady-state renders do not allocate
+  void reserve(int maxWidth, int maxHeight, int threads = 1);
 
 private:
   static const std::string ASCII_CHARS_SIMPLE;
   static const std::string ASCII_CHARS_DETAILED;
   static const std::string ASCII_CHARS_BLOCKS;
+  static const std::string ASCII_CHARS_HALF_BLOCKS;
+  static const std::string ASCII_CHARS_QUARTER_BLOCKS;
+
+  static constexpr int MIN_BAND_ROWS = 8;
+  // reduced decodes keep at least this many source pixels per cell and
+  // axis, so each cell still averages a block instead of aliasing
+  static constexpr int MIN_SAMPLES_PER_CELL = 2;
+  // progressive mode decodes a preview once this much has arrived, then
+  // whenever the received size doubles, but never more often than this
+  static constexpr size_t PREVIEW_FIRST_BYTES = 32 * 1024;
+  static constexpr std::chrono::milliseconds PREVIEW_INTERVAL{100};
+  // bumped whenever the frame format changes, invalidating cached frames
+  static constexpr uint32_t FRAME_CACHE_VERSION = 1;
+
+  // color setup shared by every band of a frame
+  struct ColorMapping {
+    const Palette *palette = nullptr;
+    std::array<uint8_t, Palette::MAX_COLORS> codes{};
+  };
+
+  // output and scratch space for one band of rows; the serial path renders
+  // straight into `frame` using the first band's scratch
+  struct Band {
+    FrameBuffer frame;
+    CellSampler sampler;
+    std::vector<uint8_t> paletteIndices;
+  };
+
+  FrameBuffer frame;
+  std::vector<Band> bands;
+  std::vector<std::thread> workers;
+  // backing storage for the sampled color and luma planes, only ever grown
+  std::vector<uchar> sampleStorage;
+  std::vector<uchar> lumaStorage;
+  cv::Mat decoded;
+  std::string downloaded;
+  ImageCache *cache = nullptr;
+  FrameCache *frameCache = nullptr;
+  Stats *stats = nullptr;
+  HttpClient *http = nullptr;
+  // cells currently on screen during playback, and the next frame's
+  CellGrid shownCells;
+  CellGrid nextCells;
+  std::unique_ptr<Palette> customPalette;
+  std::string customPalettePath;
+  std::filesystem::file_time_type customPaletteTime;
 
-  const std::string &getCharSet(CharStyle style) const;
-  std::vector<std::string> splitCharSet(const std::string &charSet);
-  void renderImage(cv::Mat &img, const RenderOptions &options);
-  void renderGrayScaleAscii(const cv::Mat &img, const std::string &charSet,
-                            const bool &usePallete);
-  void renderColorAscii(const cv::Mat &img, const std::string &charSet,
-                        const bool &usePallete);
+  const GlyphTable &getGlyphTable(CharStyle style) const;
+  cv::Size minDecodeSize(const RenderOptions &options) const;
+  static cv::Mat planeView(std::vector<uchar> &storage, int rows, int cols,
+                           int type, int channels);
+  bool download(const std::string &imgUrl, std::string &body);
+  cv::Mat fetchImage(const std::string &imgUrl, int minCols, int minRows);
+  cv::Mat decodeDownloaded(int minCols, int minRows);
+  uint64_t frameKey(const std::string &imageBytes,
+                    const RenderOptions &options);
+  bool streamToAscii(const std::string &imgUrl, const RenderOptions &options,
+                     FrameSink &sink);
+  bool playAnimation(const std::string &imgUrl, const RenderOptions &options,
+                     FrameSink &sink);
+  // the frame's size in cells for these options
+  cv::Size gridSize(const cv::Mat &img, const RenderOptions &options) const;
+  // appends the frame to a FrameBuffer, or maps it into a CellGrid, and
+  // returns the number of rows rendered
+  template <typename Target>
+  int renderImage(const cv::Mat &img, const RenderOptions &options,
+                  Target &out);
+  // the row mappers write through an SgrWriter or a CellGrid::Writer
+  template <typename Writer>
+  void renderGrayScaleAscii(const cv::Mat &gray, int rowBegin, int rowEnd,
+                            const GlyphTable &glyphs, Writer &out);
+  template <typename Writer>
+  void renderColorAscii(const cv::Mat &img, const cv::Mat &gray, int rowBegin,
+                        int rowEnd, const GlyphTable &glyphs,
+                        const ColorMapping &colors,
+                        const RenderOptions &options, Writer &out,
+                        std::vector<uint8_t> &indices);
+  template <typename Writer>
+  void renderBlockCells(const cv::Mat &samples, const cv::Mat &luma,
+                        int rowBegin, int rowEnd, const GlyphTable &glyphs,
+                        const ColorMapping &colors,
+                        const RenderOptions &options, Writer &out);
+  template <typename Writer>
+  void setColor(Writer &out, const ColorMapping &colors,
+                const RenderOptions &options, bool foreground, int r, int g,
+                int b) const;
+  const Palette *selectPalette(const RenderOptions &options);
+  ColorMapping prepareColorMapping(const RenderOptions &options);
+  bool emitFrame(FrameSink &sink);
 };
 
 #endif // IMAGE_RENDERER_HPP
@@ -0,0 +1,91 @@
+#include "ImageSearch.hpp"
+#include "HttpClient.hpp"
+#include "json.hpp"
+#include <algorithm>
+#include <cpr/cpr.h>
+#include <iostream>
+#include <utility>
+
+using json = nlohmann::json;
+
+const std::vector<std::string> &ImageSearch::knownTags() {
+  static const std::vector<std::string> tags = {
+      "maid",          "waifu",         "marin-kitagawa",
+      "mori-calliope", "raiden-shogun", "oppai",
+      "selfies",       "uniform",       "kamisato-ayaka"};
+  return tags;
+}
+
+bool ImageSearch::parseTags(const std::string &list,
+                            std::vector<std::string> &tags) {
+  const std::vector<std::string> &known = knownTags();
+  tags.clear();
+  for (size_t begin = 0; begin <= list.size();) {
+    size_t end = std::min(list.find(',', begin), list.size());
+    std::string tag = list.substr(begin, end - begin);
+    if (std::find(known.begin(), known.end(), tag) == known.end()) {
+      return false;
+    }
+    tags.push_back(std::move(tag));
+    begin = end + 1;
+  }
+  return true;
+}
+
+ImageSearch::ImageSearch(std::vector<std::string> tags, int batchSize)
+    : tags(std::move(tags)),
+      batchSize(std::min(std::max(batchSize, 1), MAX_BATCH)) {}
+
+bool ImageSearch::next(std::string &imgUrl) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (queue.empty() && !refill()) {
+    return false;
+  }
+  imgUrl = std::move(queue.front());
+  queue.pop_front();
+  return true;
+}
+
+size_t ImageSearch::pending() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return queue.size();
+}
+
+bool ImageSearch::refill() {
+  Stats::Timer timer(stats, Stats::SEARCH);
+  cpr::Parameters parameters;
+  for (const std::string &tag : tags) {
+    parameters.Add({"included_tags", tag});
+  }
+  parameters.Add({"limit", std::to_string(batchSize)});
+
+  auto response = http ? http->get(searchUrl, cpr::Header{}, parameters)
+                       : cpr::Get(cpr::Url{searchUrl}, parameters);
+  if (stats) {
+    stats->addResponse(response);
+  }
+  if (response.status_code != 200) {
+    std::cerr << "Error: API request failed. Status: " << response.status_code
+              << std::endl;
+    return false;
+  }
+
+  try {
+    json data = json::parse(response.text);
+    if (!data.contains("images") || !data["images"].is_array() ||
+        data["images"].empty()) {
+      std::cerr << "Error: API response doesn't contain valid image data.\n";
+      return false;
+    }
+    for (const json &image : data["images"]) {
+      if (image.contains("url") && image["url"].is_string()) {
+        queue.push_back(image["url"].get<std::string>());
+      }
+    }
+  } catch (const json::exception &e) {
+    std::cerr << "Error: Failed to parse API response. " << e.what()
+              << std::endl;
+    return false;
+  }
+  return !queue.empty();
+}
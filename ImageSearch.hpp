@@ -0,0 +1,62 @@
+#ifndef IMAGE_SEARCH_HPP
+#define IMAGE_SEARCH_HPP
+
+#include "Stats.hpp"
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+class HttpClient;
+
+/**
+ * @class ImageSearch
+ * @brief Image URLs from the waifu.im search API, fetched in batches.
+ *
+ * One request asks for up to `batchSize` images and the results are handed
+ * out one by one, so a bulk job makes one API round trip per batch instead
+ * of one per image. Safe to share between threads.
+ */
+class ImageSearch {
+public:
+  // the most the API returns per request without an access token
+  static constexpr int MAX_BATCH = 30;
+  static constexpr const char *SEARCH_URL = "https://api.waifu.im/search";
+
+  // the tags the API is searched with, in the order they are listed
+  static const std::vector<std::string> &knownTags();
+  // splits a comma-separated tag list; false when a tag is not known
+  static bool parseTags(const std::string &list,
+                        std::vector<std::string> &tags);
+
+  // images must carry every tag in `tags`
+  explicit ImageSearch(std::vector<std::string> tags, int batchSize = 1);
+
+  // next image URL, querying the API only once the queue has run dry;
+  // false (with a message on stderr) when the API gives nothing
+  bool next(std::string &imgUrl);
+  size_t pending();
+
+  // records API round trips into `stats` (not owned, may be null)
+  void setStats(Stats *stats) { this->stats = stats; }
+  // sends requests through `http` (not owned, may be null)
+  void setHttpClient(HttpClient *http) { this->http = http; }
+
+  // queries `url` instead of SEARCH_URL, e.g. a local stand-in of the API
+  void setSearchUrl(std::string url) { searchUrl = std::move(url); }
+
+private:
+  std::vector<std::string> tags;
+  int batchSize;
+  std::string searchUrl = SEARCH_URL;
+  Stats *stats = nullptr;
+  HttpClient *http = nullptr;
+  std::mutex mutex;
+  std::deque<std::string> queue;
+
+  bool refill();
+};
+
+#endif // IMAGE_SEARCH_HPP
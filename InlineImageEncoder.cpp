@@ -0,0 +1,276 @@
+#include "InlineImageEncoder.hpp"
+#include "Palette.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// kitty wants base64 payloads in chunks of at most 4096 bytes, which is
+// exactly 3072 raw bytes with no padding in between
+constexpr size_t KITTY_CHUNK_RAW = 3072;
+
+void appendBase64(const uchar *data, size_t size, FrameBuffer &out) {
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  size_t i = 0;
+  for (; i + 3 <= size; i += 3) {
+    uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+    char quad[4] = {alphabet[v >> 18], alphabet[(v >> 12) & 63],
+                    alphabet[(v >> 6) & 63], alphabet[v & 63]};
+    out.append(quad, 4);
+  }
+  if (i < size) {
+    uint32_t v = data[i] << 16;
+    if (i + 1 < size) {
+      v |= data[i + 1] << 8;
+    }
+    char quad[4] = {alphabet[v >> 18], alphabet[(v >> 12) & 63],
+                    i + 1 < size ? alphabet[(v >> 6) & 63] : '=', '='};
+    out.append(quad, 4);
+  }
+}
+
+bool envEquals(const char *name, const char *value) {
+  const char *env = std::getenv(name);
+  return env && std::strcmp(env, value) == 0;
+}
+
+void appendSixelRun(char sixel, int count, FrameBuffer &out) {
+  if (count > 3) {
+    out.append('!');
+    out.appendUInt(count);
+    out.append(sixel);
+  } else {
+    while (count-- > 0) {
+      out.append(sixel);
+    }
+  }
+}
+
+} // namespace
+
+InlineImageEncoder::Protocol InlineImageEncoder::detect() {
+  if (std::getenv("KITTY_WINDOW_ID") || envEquals("TERM", "xterm-kitty") ||
+      envEquals("TERM", "xterm-ghostty")) {
+    return KITTY;
+  }
+  if (envEquals("TERM_PROGRAM", "iTerm.app") ||
+      envEquals("LC_TERMINAL", "iTerm2") ||
+      envEquals("TERM_PROGRAM", "WezTerm")) {
+    return ITERM;
+  }
+  // plain xterm, tmux and the Linux console would print sixels as garbage
+  if (envEquals("TERM", "foot") || envEquals("TERM", "foot-extra") ||
+      envEquals("TERM", "mlterm") || envEquals("TERM", "contour")) {
+    return SIXEL;
+  }
+  return NONE;
+}
+
+void InlineImageEncoder::cellSize(int &cellWidth, int &cellHeight) {
+  cellWidth = 10;
+  cellHeight = 20;
+
+  winsize ws{};
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 &&
+      ws.ws_row > 0 && ws.ws_xpixel > 0 && ws.ws_ypixel > 0) {
+    cellWidth = std::max(1, ws.ws_xpixel / ws.ws_col);
+    cellHeight = std::max(1, ws.ws_ypixel / ws.ws_row);
+  }
+}
+
+bool InlineImageEncoder::encode(const cv::Mat &img, Protocol protocol,
+                                int cols, int rows, cv::Size cell,
+                                FrameBuffer &out) {
+  if (img.empty() || cols <= 0 || rows <= 0 || cell.width <= 0 ||
+      cell.height <= 0) {
+    return false;
+  }
+  if (protocol == AUTO) {
+    protocol = detect();
+  }
+  if (protocol == NONE) {
+    return false;
+  }
+
+  const int cellWidth = cell.width;
+  const int cellHeight = cell.height;
+
+  // fitting the image into the cell grid in pixels, so nothing larger than
+  // what will be displayed gets encoded
+  double scale = std::min(static_cast<double>(cols) * cellWidth / img.cols,
+                          static_cast<double>(rows) * cellHeight / img.rows);
+  int pixelWidth =
+      std::max(1, static_cast<int>(std::lround(img.cols * scale)));
+  int pixelHeight =
+      std::max(1, static_cast<int>(std::lround(img.rows * scale)));
+
+  cv::Mat scaled;
+  cv::resize(img, scaled, cv::Size(pixelWidth, pixelHeight), 0, 0,
+             cv::INTER_AREA);
+
+  int usedCols = (pixelWidth + cellWidth - 1) / cellWidth;
+  int usedRows = (pixelHeight + cellHeight - 1) / cellHeight;
+
+  bool ok = true;
+  switch (protocol) {
+  case KITTY:
+    ok = encodeKitty(scaled, usedCols, usedRows, out);
+    break;
+  case ITERM:
+    ok = encodeIterm(scaled, usedCols, usedRows, out);
+    break;
+  default:
+    encodeSixel(scaled, out);
+    break;
+  }
+  out.append('\n');
+  return ok;
+}
+
+void InlineImageEncoder::encodeSixel(const cv::Mat &img, FrameBuffer &out) {
+  const int width = img.cols;
+  const int height = img.rows;
+  const Palette &palette = Palette::xterm256();
+
+  std::vector<uint8_t> indices(static_cast<size_t>(width) * height);
+  bool used[Palette::MAX_COLORS] = {};
+  for (int y = 0; y < height; y++) {
+    uint8_t *row = indices.data() + static_cast<size_t>(y) * width;
+    palette.quantize(img.ptr<uchar>(y), width, row);
+    for (int x = 0; x < width; x++) {
+      used[row[x]] = true;
+    }
+  }
+
+  out.append("\x1bPq\"1;1;");
+  out.appendUInt(width);
+  out.append(';');
+  out.appendUInt(height);
+
+  // color registers, in percent
+  for (size_t c = 0; c < palette.size(); c++) {
+    if (!used[c]) {
+      continue;
+    }
+    out.append('#');
+    out.appendUInt(static_cast<unsigned>(c));
+    out.append(";2;");
+    out.appendUInt(palette[c].r * 100 / 255);
+    out.append(';');
+    out.appendUInt(palette[c].g * 100 / 255);
+    out.append(';');
+    out.appendUInt(palette[c].b * 100 / 255);
+  }
+
+  // one bit row per color register, reset after each band
+  std::vector<uint8_t> bits(Palette::MAX_COLORS *
+                            static_cast<size_t>(width));
+  std::vector<uint8_t> present;
+  present.reserve(Palette::MAX_COLORS);
+
+  for (int top = 0; top < height; top += 6) {
+    const int bandHeight = std::min(6, height - top);
+    bool seen[Palette::MAX_COLORS] = {};
+    present.clear();
+
+    for (int k = 0; k < bandHeight; k++) {
+      const uint8_t *row =
+          indices.data() + static_cast<size_t>(top + k) * width;
+      for (int x = 0; x < width; x++) {
+        uint8_t c = row[x];
+        if (!seen[c]) {
+          seen[c] = true;
+          present.push_back(c);
+        }
+        bits[c * static_cast<size_t>(width) + x] |= 1 << k;
+      }
+    }
+
+    for (size_t p = 0; p < present.size(); p++) {
+      uint8_t *colorBits =
+          bits.data() + present[p] * static_cast<size_t>(width);
+      int last = width - 1;
+      while (last >= 0 && colorBits[last] == 0) {
+        last--;
+      }
+
+      out.append('#');
+      out.appendUInt(present[p]);
+      char run = 0;
+      int runLength = 0;
+      for (int x = 0; x <= last; x++) {
+        char sixel = static_cast<char>('?' + colorBits[x]);
+        if (sixel == run) {
+          runLength++;
+        } else {
+          appendSixelRun(run, runLength, out);
+          run = sixel;
+          runLength = 1;
+        }
+      }
+      appendSixelRun(run, runLength, out);
+      std::fill(colorBits, colorBits + width, 0);
+
+      // '$' returns to the start of the band for the next color
+      if (p + 1 < present.size()) {
+        out.append('$');
+      }
+    }
+    out.append('-');
+  }
+  out.append("\x1b\\");
+}
+
+bool InlineImageEncoder::encodeKitty(const cv::Mat &img, int cols, int rows,
+                                     FrameBuffer &out) {
+  std::vector<uchar> png;
+  if (!cv::imencode(".png", img, png)) {
+    return false;
+  }
+
+  for (size_t offset = 0; offset < png.size(); offset += KITTY_CHUNK_RAW) {
+    size_t chunk = std::min(KITTY_CHUNK_RAW, png.size() - offset);
+    bool more = offset + chunk < png.size();
+
+    out.append("\x1b_G");
+    if (offset == 0) {
+      out.append("a=T,f=100,c=");
+      out.appendUInt(cols);
+      out.append(",r=");
+      out.appendUInt(rows);
+      out.append(',');
+    }
+    out.append("m=");
+    out.append(more ? '1' : '0');
+    out.append(';');
+    appendBase64(png.data() + offset, chunk, out);
+    out.append("\x1b\\");
+  }
+  return true;
+}
+
+bool InlineImageEncoder::encodeIterm(const cv::Mat &img, int cols, int rows,
+                                     FrameBuffer &out) {
+  std::vector<uchar> png;
+  if (!cv::imencode(".png", img, png)) {
+    return false;
+  }
+
+  out.append("\x1b]1337;File=inline=1;size=");
+  out.appendUInt(static_cast<unsigned>(png.size()));
+  out.append(";width=");
+  out.appendUInt(cols);
+  out.append(";height=");
+  out.appendUInt(rows);
+  out.append(";preserveAspectRatio=1:");
+  appendBase64(png.data(), png.size(), out);
+  out.append('\a');
+  return true;
+}
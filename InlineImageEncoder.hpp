@@ -0,0 +1,37 @@
+#ifndef INLINE_IMAGE_ENCODER_HPP
+#define INLINE_IMAGE_ENCODER_HPP
+
+#include "FrameBuffer.hpp"
+#include <opencv2/opencv.hpp>
+
+/**
+ * @class InlineImageEncoder
+ * @brief Encodes a decoded image for terminals that can display real pixels:
+ * DEC sixel, the kitty graphics protocol, or iTerm2 inline images.
+ */
+class InlineImageEncoder {
+public:
+  // NONE is a terminal that cannot show pixels at all
+  enum Protocol { AUTO, SIXEL, KITTY, ITERM, NONE };
+
+  // picks a protocol from the environment ($TERM, $TERM_PROGRAM, ...), or
+  // NONE when the terminal is not known to support one
+  static Protocol detect();
+
+  // size of one terminal cell in pixels, from TIOCGWINSZ when available
+  static void cellSize(int &cellWidth, int &cellHeight);
+
+  // appends the escape sequence showing `img` (8-bit BGR) scaled to fit in
+  // a grid of `cols` x `rows` cells of `cell` pixels, followed by a newline
+  static bool encode(const cv::Mat &img, Protocol protocol, int cols,
+                     int rows, cv::Size cell, FrameBuffer &out);
+
+private:
+  static void encodeSixel(const cv::Mat &img, FrameBuffer &out);
+  static bool encodeKitty(const cv::Mat &img, int cols, int rows,
+                          FrameBuffer &out);
+  static bool encodeIterm(const cv::Mat &img, int cols, int rows,
+                          FrameBuffer &out);
+};
+
+#endif // INLINE_IMAGE_ENCODER_HPP
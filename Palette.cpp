@@ -0,0 +1,286 @@
+#include "Palette.hpp"
+#include <climits>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define PALETTE_X86_KERNELS 1
+#endif
+
+namespace {
+
+using Kernel = void (*)(const uint8_t *bgr, int count, const int32_t *pr,
+                        const int32_t *pg, const int32_t *pb, size_t n,
+                        uint8_t *indices);
+
+uint8_t nearestScalar(int r, int g, int b, const int32_t *pr,
+                      const int32_t *pg, const int32_t *pb, size_t n) {
+  int bestDist = INT_MAX;
+  size_t best = 0;
+  for (size_t k = 0; k < n; k++) {
+    int dr = r - pr[k], dg = g - pg[k], db = b - pb[k];
+    int dist = dr * dr + dg * dg + db * db;
+    if (dist < bestDist) {
+      bestDist = dist;
+      best = k;
+    }
+  }
+  return static_cast<uint8_t>(best);
+}
+
+void quantizeScalar(const uint8_t *bgr, int count, const int32_t *pr,
+                    const int32_t *pg, const int32_t *pb, size_t n,
+                    uint8_t *indices) {
+  for (int i = 0; i < count; i++) {
+    const uint8_t *p = bgr + i * 3;
+    indices[i] = nearestScalar(p[2], p[1], p[0], pr, pg, pb, n);
+  }
+}
+
+#ifdef PALETTE_X86_KERNELS
+
+__attribute__((target("sse4.1"))) void
+quantizeSse41(const uint8_t *bgr, int count, const int32_t *pr,
+              const int32_t *pg, const int32_t *pb, size_t n,
+              uint8_t *indices) {
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const uint8_t *p = bgr + i * 3;
+    __m128i b = _mm_setr_epi32(p[0], p[3], p[6], p[9]);
+    __m128i g = _mm_setr_epi32(p[1], p[4], p[7], p[10]);
+    __m128i r = _mm_setr_epi32(p[2], p[5], p[8], p[11]);
+
+    __m128i bestDist = _mm_set1_epi32(INT_MAX);
+    __m128i bestIdx = _mm_setzero_si128();
+    for (size_t k = 0; k < n; k++) {
+      __m128i dr = _mm_sub_epi32(r, _mm_set1_epi32(pr[k]));
+      __m128i dg = _mm_sub_epi32(g, _mm_set1_epi32(pg[k]));
+      __m128i db = _mm_sub_epi32(b, _mm_set1_epi32(pb[k]));
+      __m128i dist = _mm_add_epi32(
+          _mm_add_epi32(_mm_mullo_epi32(dr, dr), _mm_mullo_epi32(dg, dg)),
+          _mm_mullo_epi32(db, db));
+
+      // strict less-than keeps the first of equally close entries
+      __m128i closer = _mm_cmplt_epi32(dist, bestDist);
+      bestDist = _mm_min_epi32(dist, bestDist);
+      bestIdx = _mm_blendv_epi8(bestIdx, _mm_set1_epi32(static_cast<int>(k)),
+                                closer);
+    }
+
+    alignas(16) int32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), bestIdx);
+    for (int l = 0; l < 4; l++) {
+      indices[i + l] = static_cast<uint8_t>(lanes[l]);
+    }
+  }
+  quantizeScalar(bgr + i * 3, count - i, pr, pg, pb, n, indices + i);
+}
+
+__attribute__((target("avx2"))) void
+quantizeAvx2(const uint8_t *bgr, int count, const int32_t *pr,
+             const int32_t *pg, const int32_t *pb, size_t n,
+             uint8_t *indices) {
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const uint8_t *p = bgr + i * 3;
+    __m256i b = _mm256_setr_epi32(p[0], p[3], p[6], p[9], p[12], p[15], p[18],
+                                  p[21]);
+    __m256i g = _mm256_setr_epi32(p[1], p[4], p[7], p[10], p[13], p[16],
+                                  p[19], p[22]);
+    __m256i r = _mm256_setr_epi32(p[2], p[5], p[8], p[11], p[14], p[17],
+                                  p[20], p[23]);
+
+    __m256i bestDist = _mm256_set1_epi32(INT_MAX);
+    __m256i bestIdx = _mm256_setzero_si256();
+    for (size_t k = 0; k < n; k++) {
+      __m256i dr = _mm256_sub_epi32(r, _mm256_set1_epi32(pr[k]));
+      __m256i dg = _mm256_sub_epi32(g, _mm256_set1_epi32(pg[k]));
+      __m256i db = _mm256_sub_epi32(b, _mm256_set1_epi32(pb[k]));
+      __m256i dist = _mm256_add_epi32(
+          _mm256_add_epi32(_mm256_mullo_epi32(dr, dr),
+                           _mm256_mullo_epi32(dg, dg)),
+          _mm256_mullo_epi32(db, db));
+
+      __m256i closer = _mm256_cmpgt_epi32(bestDist, dist);
+      bestDist = _mm256_min_epi32(dist, bestDist);
+      bestIdx = _mm256_blendv_epi8(
+          bestIdx, _mm256_set1_epi32(static_cast<int>(k)), closer);
+    }
+
+    alignas(32) int32_t lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), bestIdx);
+    for (int l = 0; l < 8; l++) {
+      indices[i + l] = static_cast<uint8_t>(lanes[l]);
+    }
+  }
+  quantizeSse41(bgr + i * 3, count - i, pr, pg, pb, n, indices + i);
+}
+
+#endif // PALETTE_X86_KERNELS
+
+Kernel selectKernel() {
+#ifdef PALETTE_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return quantizeAvx2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return quantizeSse41;
+  }
+#endif
+  return quantizeScalar;
+}
+
+inline size_t cubeIndex(uint8_t r, uint8_t g, uint8_t b) {
+  return (static_cast<size_t>(r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+}
+
+} // namespace
+
+Palette::Palette(std::vector<Color> colorList) : colors(std::move(colorList)) {
+  if (colors.empty()) {
+    colors.push_back({0, 0, 0});
+  }
+  if (colors.size() > MAX_COLORS) {
+    colors.resize(MAX_COLORS);
+  }
+
+  for (const Color &color : colors) {
+    planeR.push_back(color.r);
+    planeG.push_back(color.g);
+    planeB.push_back(color.b);
+  }
+
+  if (colors.size() > CUBE_THRESHOLD) {
+    // quantizing the center of every cube cell, one blue-axis row at a time
+    cube.reset(new uint8_t[32 * 32 * 32]);
+    uint8_t row[32 * 3];
+    for (int r = 0; r < 32; r++) {
+      for (int g = 0; g < 32; g++) {
+        for (int b = 0; b < 32; b++) {
+          row[b * 3] = static_cast<uint8_t>(b << 3 | 4);
+          row[b * 3 + 1] = static_cast<uint8_t>(g << 3 | 4);
+          row[b * 3 + 2] = static_cast<uint8_t>(r << 3 | 4);
+        }
+        quantizeExact(row, 32, cube.get() + (r << 10 | g << 5));
+      }
+    }
+  }
+}
+
+uint8_t Palette::nearest(uint8_t r, uint8_t g, uint8_t b) const {
+  if (cube) {
+    return cube[cubeIndex(r, g, b)];
+  }
+  return nearestScalar(r, g, b, planeR.data(), planeG.data(), planeB.data(),
+                       colors.size());
+}
+
+void Palette::quantize(const uint8_t *bgr, int count, uint8_t *indices) const {
+  if (cube) {
+    for (int i = 0; i < count; i++) {
+      const uint8_t *p = bgr + i * 3;
+      indices[i] = cube[cubeIndex(p[2], p[1], p[0])];
+    }
+    return;
+  }
+  quantizeExact(bgr, count, indices);
+}
+
+void Palette::quantizeExact(const uint8_t *bgr, int count,
+                            uint8_t *indices) const {
+  static const Kernel kernel = selectKernel();
+  kernel(bgr, count, planeR.data(), planeG.data(), planeB.data(),
+         colors.size(), indices);
+}
+
+const Palette &Palette::anime() {
+  static const Palette palette({
+      {255, 218, 185}, // Peach (skin tone)
+      {255, 192, 203}, // Pink (hair)
+      {0, 128, 255},   // Sky Blue (eyes)
+      {0, 0, 0},       // Black (outlines)
+      {255, 215, 0},   // Gold (accents)
+      {255, 99, 71}    // Tomato (bold color)
+  });
+  return palette;
+}
+
+const Palette &Palette::xterm256() {
+  static const Palette palette([] {
+    static const uint8_t levels[] = {0, 95, 135, 175, 215, 255};
+    std::vector<Color> colors;
+    for (int r = 0; r < 6; r++) {
+      for (int g = 0; g < 6; g++) {
+        for (int b = 0; b < 6; b++) {
+          colors.push_back({levels[r], levels[g], levels[b]});
+        }
+      }
+    }
+    for (int i = 0; i < 24; i++) {
+      uint8_t level = static_cast<uint8_t>(8 + i * 10);
+      colors.push_back({level, level, level});
+    }
+    return colors;
+  }());
+  return palette;
+}
+
+const Palette &Palette::ansi16() {
+  static const Palette palette({
+      {0, 0, 0},       {205, 0, 0},     {0, 205, 0},   {205, 205, 0},
+      {0, 0, 238},     {205, 0, 205},   {0, 205, 205}, {229, 229, 229},
+      {127, 127, 127}, {255, 0, 0},     {0, 255, 0},   {255, 255, 0},
+      {92, 92, 255},   {255, 0, 255},   {0, 255, 255}, {255, 255, 255},
+  });
+  return palette;
+}
+
+std::unique_ptr<Palette> Palette::fromFile(const std::string &path) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Failed to open palette file: " << path << std::endl;
+    return nullptr;
+  }
+
+  std::vector<Color> colors;
+  std::string line;
+  while (std::getline(in, line) && colors.size() < MAX_COLORS) {
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos) {
+      continue;
+    }
+
+    if (line[start] == '#') {
+      // "#rrggbb", anything else after a '#' is a comment
+      std::string hex = line.substr(start + 1, 6);
+      if (hex.size() == 6 &&
+          hex.find_first_not_of("0123456789abcdefABCDEF") ==
+              std::string::npos) {
+        unsigned long value = std::stoul(hex, nullptr, 16);
+        colors.push_back({static_cast<uint8_t>(value >> 16),
+                          static_cast<uint8_t>(value >> 8),
+                          static_cast<uint8_t>(value)});
+      }
+      continue;
+    }
+
+    // "r g b [name]", header lines such as "GIMP Palette" fail to parse
+    std::istringstream fields(line);
+    int r, g, b;
+    if (fields >> r >> g >> b && r >= 0 && r <= 255 && g >= 0 && g <= 255 &&
+        b >= 0 && b <= 255) {
+      colors.push_back({static_cast<uint8_t>(r), static_cast<uint8_t>(g),
+                        static_cast<uint8_t>(b)});
+    }
+  }
+
+  if (colors.empty()) {
+    std::cerr << "No colors found in palette file: " << path << std::endl;
+    return nullptr;
+  }
+  return std::unique_ptr<Palette>(new Palette(std::move(colors)));
+}
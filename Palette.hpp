@@ -0,0 +1,59 @@
+#ifndef PALETTE_HPP
+#define PALETTE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @class Palette
+ * @brief A fixed set of up to 256 colors plus a nearest-color quantizer.
+ *
+ * Quantization compares squared distances for many pixels at once using
+ * AVX2 or SSE4.1 when the CPU supports them, falling back to scalar code
+ * otherwise. Palettes with more than CUBE_THRESHOLD entries additionally
+ * precompute a 32x32x32 RGB cube, so quantizing a pixel is one table read.
+ */
+class Palette {
+public:
+  struct Color {
+    uint8_t r, g, b;
+  };
+
+  static constexpr size_t MAX_COLORS = 256;
+  static constexpr size_t CUBE_THRESHOLD = 16;
+
+  explicit Palette(std::vector<Color> colors);
+
+  size_t size() const { return colors.size(); }
+  const Color &operator[](size_t index) const { return colors[index]; }
+
+  // index of the entry closest to the given color
+  uint8_t nearest(uint8_t r, uint8_t g, uint8_t b) const;
+
+  // maps `count` BGR pixels (as stored by cv::Mat) to palette indices
+  void quantize(const uint8_t *bgr, int count, uint8_t *indices) const;
+
+  // the hand-picked anime palette used by RenderOptions::usePallete
+  static const Palette &anime();
+  // xterm colors 16-255 (the 6x6x6 cube and the gray ramp); entry i is
+  // terminal color i + 16, since 0-15 are usually remapped by themes
+  static const Palette &xterm256();
+  // the 16 standard ANSI colors with xterm's default values
+  static const Palette &ansi16();
+
+  // loads one color per line, either "#rrggbb" or "r g b" (GIMP .gpl
+  // palettes work as-is); returns nullptr if no colors could be read
+  static std::unique_ptr<Palette> fromFile(const std::string &path);
+
+private:
+  std::vector<Color> colors;
+  // one plane per channel, widened for the vector kernels
+  std::vector<int32_t> planeR, planeG, planeB;
+  std::unique_ptr<uint8_t[]> cube;
+
+  void quantizeExact(const uint8_t *bgr, int count, uint8_t *indices) const;
+};
+
+#endif // PALETTE_HPP
@@ -0,0 +1,129 @@
+#include "RenderService.hpp"
+#include "FrameSink.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+RenderService::RenderService(const RenderService::Options &options)
+    : options(options) {
+  const size_t count = std::max<size_t>(1, options.workers);
+  for (size_t i = 0; i < count; i++) {
+    auto worker = std::make_unique<Worker>();
+    // every worker gets its own handles on the shared directories, so no
+    // two downloads are serialized on one HTTP session
+    if (!options.cacheDirectory.empty()) {
+      worker->cache = std::make_unique<ImageCache>(options.cacheDirectory,
+                                                   options.cacheBytes);
+      worker->cache->setHttpClient(&worker->http);
+      worker->frameCache =
+          std::make_unique<FrameCache>(options.cacheDirectory + "/frames");
+      worker->renderer.setCache(worker->cache.get());
+      worker->renderer.setFrameCache(worker->frameCache.get());
+    }
+    worker->renderer.setHttpClient(&worker->http);
+    workers.push_back(std::move(worker));
+  }
+}
+
+bool RenderService::parseOptions(
+    const std::map<std::string, std::string> &query,
+    ImageRenderer::RenderOptions &options, std::string &error) {
+  options.style = ImageRenderer::DETAILED;
+  options.colorSupport = true;
+
+  auto size = [&](const char *name, int &value) {
+    auto it = query.find(name);
+    if (it == query.end()) {
+      return true;
+    }
+    value = std::atoi(it->second.c_str());
+    if (value < 1 || value > MAX_CELLS) {
+      error = std::string("Error: ") + name + " must be between 1 and " +
+              std::to_string(MAX_CELLS) + "\n";
+      return false;
+    }
+    return true;
+  };
+  if (!size("width", options.width) || !size("height", options.height)) {
+    return false;
+  }
+
+  auto style = query.find("style");
+  if (style != query.end() &&
+      !ImageRenderer::parseStyle(style->second, options.style)) {
+    error = "Error: Unknown style: " + style->second + "\n";
+    return false;
+  }
+  auto colors = query.find("colors");
+  if (colors != query.end()) {
+    if (colors->second == "none") {
+      options.colorSupport = false;
+    } else if (!ImageRenderer::parseColorMode(colors->second,
+                                              options.colorMode)) {
+      error = "Error: Unknown color mode: " + colors->second + "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+ImageSearch &RenderService::searchFor(std::vector<std::string> tags) {
+  // one queue per set of known tags, however a client orders or repeats
+  // them, which keeps the map small
+  std::sort(tags.begin(), tags.end());
+  tags.erase(std::unique(tags.begin(), tags.end()), tags.end());
+  std::string key;
+  for (const std::string &tag : tags) {
+    key += key.empty() ? tag : "," + tag;
+  }
+
+  std::lock_guard<std::mutex> lock(searchMutex);
+  std::unique_ptr<ImageSearch> &search = searches[key];
+  if (!search) {
+    search = std::make_unique<ImageSearch>(tags, ImageSearch::MAX_BATCH);
+    search->setSearchUrl(options.searchUrl);
+    search->setHttpClient(&searchHttp);
+  }
+  return *search;
+}
+
+void RenderService::handle(const HttpServer::Request &request,
+                           HttpServer::Response &response, size_t worker) {
+  if (request.path != "/render") {
+    response.status = 404;
+    return;
+  }
+  auto tag = request.query.find("tag");
+  if (tag == request.query.end() || tag->second.empty()) {
+    response.status = 400;
+    response.body = "Error: Missing tag\n";
+    return;
+  }
+  // unknown tags would each cost an API call and a search queue
+  std::vector<std::string> tags;
+  if (!ImageSearch::parseTags(tag->second, tags)) {
+    response.status = 400;
+    response.body = "Error: Not a valid tag\n";
+    return;
+  }
+
+  ImageRenderer::RenderOptions renderOptions;
+  if (!parseOptions(request.query, renderOptions, response.body)) {
+    response.status = 400;
+    return;
+  }
+
+  // ImageSearch locks internally, the map lock only guards the lookup
+  std::string imgUrl;
+  if (!searchFor(std::move(tags)).next(imgUrl)) {
+    response.status = 502;
+    response.body = "Error: No image found\n";
+    return;
+  }
+
+  StringSink sink(response.body);
+  if (!workers[worker % workers.size()]->renderer.urlToAscii(
+          imgUrl, renderOptions, sink)) {
+    response.status = 502;
+    response.body = "Error: Failed to render " + imgUrl + "\n";
+  }
+}
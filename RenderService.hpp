@@ -0,0 +1,73 @@
+#ifndef RENDER_SERVICE_HPP
+#define RENDER_SERVICE_HPP
+
+#include "HttpClient.hpp"
+#include "HttpServer.hpp"
+#include "ImageRenderer.hpp"
+#include "ImageSearch.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @class RenderService
+ * @brief Answers `GET /render?tag=...&width=...&style=...` with an ASCII
+ * frame, for other tools to show images without linking the renderer.
+ *
+ * Meant as the handler of an HttpServer with the same number of workers:
+ * each worker renders with its own ImageRenderer, HTTP connections and
+ * cache handles, so requests on different workers never wait on each
+ * other. Search results are shared, one batched queue per tag list.
+ *
+ * Query parameters: `tag` (required, comma-separated, known tags only),
+ * `width` and `height` in cells, `style` and `colors` as on the command
+ * line, plus `colors=none` for plain ASCII.
+ */
+class RenderService {
+public:
+  struct Options {
+    size_t workers = 4;
+    // where to search for images, a local stand-in of the API in load tests
+    std::string searchUrl = ImageSearch::SEARCH_URL;
+    // image and frame caches below this directory, none when empty
+    std::string cacheDirectory;
+    uint64_t cacheBytes = ImageCache::DEFAULT_MAX_BYTES;
+  };
+
+  // grid sizes beyond this are refused rather than rendered
+  static constexpr int MAX_CELLS = 1000;
+
+  explicit RenderService(const Options &options);
+
+  RenderService(const RenderService &) = delete;
+  RenderService &operator=(const RenderService &) = delete;
+
+  void handle(const HttpServer::Request &request,
+              HttpServer::Response &response, size_t worker);
+
+private:
+  struct Worker {
+    HttpClient http;
+    std::unique_ptr<ImageCache> cache;
+    std::unique_ptr<FrameCache> frameCache;
+    ImageRenderer renderer;
+  };
+
+  Options options;
+  std::vector<std::unique_ptr<Worker>> workers;
+  // searches only, each worker downloads over its own client
+  HttpClient searchHttp;
+  std::mutex searchMutex;
+  std::map<std::string, std::unique_ptr<ImageSearch>> searches;
+
+  static bool parseOptions(const std::map<std::string, std::string> &query,
+                           ImageRenderer::RenderOptions &options,
+                           std::string &error);
+  ImageSearch &searchFor(std::vector<std::string> tags);
+};
+
+#endif // RENDER_SERVICE_HPP
@@ -0,0 +1,113 @@
+#ifndef SGR_WRITER_HPP
+#define SGR_WRITER_HPP
+
+#include "FrameBuffer.hpp"
+#include "GlyphTable.hpp"
+#include <cstdlib>
+
+/**
+ * @class SgrWriter
+ * @brief Tracks the terminal's current SGR state while a frame is being
+ * formatted and only emits escape sequences when a cell actually changes it.
+ *
+ * Colors within `tolerance` (per channel) of the active color are treated as
+ * identical, and the attributes are reset once per line instead of per cell.
+ */
+class SgrWriter {
+public:
+  explicit SgrWriter(FrameBuffer &frame, int tolerance = 0)
+      : frame(frame), tolerance(tolerance) {}
+
+  void background(int r, int g, int b) { setRgb(bg, "\x1b[48;2;", r, g, b); }
+  void foreground(int r, int g, int b) { setRgb(fg, "\x1b[38;2;", r, g, b); }
+
+  // xterm 256-color palette, "48;5;n" / "38;5;n"
+  void background256(int index) { setIndexed(bg, "\x1b[48;5;", index); }
+  void foreground256(int index) { setIndexed(fg, "\x1b[38;5;", index); }
+
+  // the 16 ANSI colors, "40".."47" / "100".."107" and "30".."37" / "90".."97"
+  void background16(int index) { setAnsi(bg, 40, 100, index); }
+  void foreground16(int index) { setAnsi(fg, 30, 90, index); }
+
+  // room for `bytes` more bytes of output
+  void reserve(size_t bytes) { frame.reserve(frame.size() + bytes); }
+
+  void glyph(const GlyphTable::Glyph &glyph) {
+    frame.append(glyph.bytes, glyph.length);
+  }
+
+  void glyphRow(const GlyphTable &glyphs, const uint8_t *levels, int count) {
+    glyphs.encodeRow(levels, count, frame);
+  }
+
+  void endLine() {
+    if (fg.active || bg.active) {
+      frame.append("\x1b[0m");
+      fg.active = false;
+      bg.active = false;
+    }
+    frame.append('\n');
+  }
+
+private:
+  struct Channel {
+    bool active = false;
+    int r = 0, g = 0, b = 0;
+    int index = -1;
+  };
+
+  FrameBuffer &frame;
+  int tolerance;
+  Channel fg, bg;
+
+  bool close(int a, int b) const { return std::abs(a - b) <= tolerance; }
+
+  template <size_t N>
+  void setRgb(Channel &channel, const char (&prefix)[N], int r, int g,
+              int b) {
+    if (channel.active && close(r, channel.r) && close(g, channel.g) &&
+        close(b, channel.b)) {
+      return;
+    }
+    frame.append(prefix);
+    frame.appendUInt(r);
+    frame.append(';');
+    frame.appendUInt(g);
+    frame.append(';');
+    frame.appendUInt(b);
+    frame.append('m');
+
+    channel.r = r;
+    channel.g = g;
+    channel.b = b;
+    channel.active = true;
+  }
+
+  template <size_t N>
+  void setIndexed(Channel &channel, const char (&prefix)[N], int index) {
+    if (channel.active && index == channel.index) {
+      return;
+    }
+    frame.append(prefix);
+    frame.appendUInt(index);
+    frame.append('m');
+
+    channel.index = index;
+    channel.active = true;
+  }
+
+  void setAnsi(Channel &channel, int normalBase, int brightBase, int index) {
+    if (channel.active && index == channel.index) {
+      return;
+    }
+    frame.append("\x1b[");
+    frame.appendUInt(index < 8 ? normalBase + index
+                               : brightBase + index - 8);
+    frame.append('m');
+
+    channel.index = index;
+    channel.active = true;
+  }
+};
+
+#endif // SGR_WRITER_HPP
@@ -0,0 +1,89 @@
+#include "Slideshow.hpp"
+#include "FrameSink.hpp"
+#include <algorithm>
+#include <utility>
+
+Slideshow::Slideshow(UrlSource source,
+                     const ImageRenderer::RenderOptions &options, bool ascii,
+                     size_t depth)
+    : source(std::move(source)), options(options), ascii(ascii),
+      depth(std::max<size_t>(1, depth)) {
+  // frames are rendered ahead of time, so nothing may draw incrementally
+  this->options.progressive = false;
+  this->options.animate = false;
+}
+
+Slideshow::~Slideshow() { stop(); }
+
+void Slideshow::start() {
+  if (!worker.joinable()) {
+    worker = std::thread(&Slideshow::run, this);
+  }
+}
+
+void Slideshow::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  notFull.notify_all();
+  notEmpty.notify_all();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+bool Slideshow::next(std::string &frame) {
+  std::unique_lock<std::mutex> lock(mutex);
+  notEmpty.wait(lock, [this] { return !ready.empty() || finished; });
+  if (ready.empty()) {
+    return false;
+  }
+  frame = std::move(ready.front());
+  ready.pop_front();
+  notFull.notify_one();
+  return true;
+}
+
+bool Slideshow::produce(std::string &frame) {
+  std::string imgUrl;
+  if (!source(imgUrl)) {
+    return false;
+  }
+
+  // each slide replaces the previous one from the top of the screen
+  frame = "\x1b[H\x1b[2J";
+  StringSink sink(frame);
+  return ascii ? renderer.urlToAscii(imgUrl, options, sink)
+               : renderer.urlToImage(imgUrl, options, sink);
+}
+
+void Slideshow::run() {
+  int failures = 0;
+  while (failures < MAX_FAILURES) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      notFull.wait(lock, [this] { return ready.size() < depth || stopping; });
+      if (stopping) {
+        break;
+      }
+    }
+
+    // the network and render work happens outside the lock, while the
+    // consumer keeps taking frames
+    std::string frame;
+    if (!produce(frame)) {
+      failures++;
+      continue;
+    }
+    failures = 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ready.push_back(std::move(frame));
+    notEmpty.notify_one();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  finished = true;
+  notEmpty.notify_all();
+}
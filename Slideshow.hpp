@@ -0,0 +1,69 @@
+#ifndef SLIDESHOW_HPP
+#define SLIDESHOW_HPP
+
+#include "ImageRenderer.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * @class Slideshow
+ * @brief Keeps the next few images searched, downloaded, decoded and
+ * rendered on a background thread, so showing the next one is a single
+ * write of a finished frame.
+ */
+class Slideshow {
+public:
+  // yields the URL of the next image to show, false when none is available
+  using UrlSource = std::function<bool(std::string &imgUrl)>;
+
+  // up to `depth` finished frames are kept ready; `ascii` picks urlToAscii
+  // over urlToImage
+  Slideshow(UrlSource source, const ImageRenderer::RenderOptions &options,
+            bool ascii, size_t depth = 2);
+  ~Slideshow();
+
+  Slideshow(const Slideshow &) = delete;
+  Slideshow &operator=(const Slideshow &) = delete;
+
+  // forwarded to the background renderer, call before start()
+  void setCache(ImageCache *cache) { renderer.setCache(cache); }
+  void setFrameCache(FrameCache *frameCache) {
+    renderer.setFrameCache(frameCache);
+  }
+  void setHttpClient(HttpClient *http) { renderer.setHttpClient(http); }
+
+  void start();
+  void stop();
+
+  // blocks until the next frame is ready and moves it into `frame`; false
+  // once the source has run dry and every prefetched frame was taken
+  bool next(std::string &frame);
+
+private:
+  // consecutive failed images after which the pipeline gives up
+  static constexpr int MAX_FAILURES = 5;
+
+  UrlSource source;
+  ImageRenderer::RenderOptions options;
+  bool ascii;
+  size_t depth;
+  ImageRenderer renderer;
+
+  std::mutex mutex;
+  std::condition_variable notFull;
+  std::condition_variable notEmpty;
+  std::deque<std::string> ready;
+  bool stopping = false;
+  bool finished = false;
+  std::thread worker;
+
+  void run();
+  bool produce(std::string &frame);
+};
+
+#endif // SLIDESHOW_HPP
@@ -0,0 +1,64 @@
+#include "Stats.hpp"
+#include "json.hpp"
+#include <algorithm>
+#include <cpr/cpr.h>
+#include <cstdio>
+
+using json = nlohmann::json;
+
+const char *const Stats::STAGE_NAMES[Stats::STAGES] = {
+    "search", "download", "decode", "preprocess", "map", "emit"};
+
+void Stats::add(Stats::Stage stage,
+                std::chrono::steady_clock::duration elapsed) {
+  nanos[stage] +=
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  counts[stage]++;
+}
+
+void Stats::addResponse(const cpr::Response &response) {
+  requests++;
+  redirects += static_cast<uint64_t>(std::max(0L, response.redirect_count));
+  transferNanos += static_cast<uint64_t>(response.elapsed * 1e9);
+  if (response.downloaded_bytes > 0) {
+    downloadedBytes += static_cast<uint64_t>(response.downloaded_bytes);
+  }
+}
+
+void Stats::printTable(std::ostream &out) const {
+  char line[96];
+  std::snprintf(line, sizeof(line), "%-12s %8s %12s %12s\n", "stage",
+                "count", "total ms", "mean ms");
+  out << line;
+  for (int stage = 0; stage < STAGES; stage++) {
+    const uint64_t count = counts[stage];
+    const double ms = nanos[stage] / 1e6;
+    std::snprintf(line, sizeof(line), "%-12s %8llu %12.2f %12.2f\n",
+                  STAGE_NAMES[stage], static_cast<unsigned long long>(count),
+                  ms, count ? ms / count : 0.0);
+    out << line;
+  }
+  std::snprintf(line, sizeof(line),
+                "http: %llu requests, %llu redirects, %.2f ms transferring\n",
+                static_cast<unsigned long long>(requests.load()),
+                static_cast<unsigned long long>(redirects.load()),
+                transferNanos / 1e6);
+  out << line;
+  out << "downloaded: " << downloadedBytes << " bytes\n";
+  out << "emitted: " << emittedBytes << " bytes\n";
+  out.flush();
+}
+
+void Stats::printJson(std::ostream &out) const {
+  json stats;
+  for (int stage = 0; stage < STAGES; stage++) {
+    stats["stages"][STAGE_NAMES[stage]] = {{"count", counts[stage].load()},
+                                           {"ms", nanos[stage] / 1e6}};
+  }
+  stats["http"] = {{"requests", requests.load()},
+                   {"redirects", redirects.load()},
+                   {"ms", transferNanos / 1e6}};
+  stats["downloadedBytes"] = downloadedBytes.load();
+  stats["emittedBytes"] = emittedBytes.load();
+  out << stats.dump(2) << std::endl;
+}
@@ -0,0 +1,74 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace cpr {
+class Response;
+}
+
+/**
+ * @class Stats
+ * @brief Time spent in each stage of the fetch-and-render pipeline, plus
+ * what went over the network and out to the terminal.
+ *
+ * Components record into it when given one through their setStats() and
+ * skip all timing when they are not. Safe to share between threads; stages
+ * running in parallel bands add up their time, so with several threads the
+ * preprocess and map totals are CPU time rather than wall time.
+ */
+class Stats {
+public:
+  enum Stage { SEARCH, DOWNLOAD, DECODE, PREPROCESS, MAP, EMIT, STAGES };
+
+  // adds the time between construction and destruction to `stage` of
+  // `stats`, which may be null
+  class Timer {
+  public:
+    Timer(Stats *stats, Stage stage) : stats(stats), stage(stage) {
+      if (stats) {
+        start = std::chrono::steady_clock::now();
+      }
+    }
+    ~Timer() {
+      if (stats) {
+        stats->add(stage, std::chrono::steady_clock::now() - start);
+      }
+    }
+
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+
+  private:
+    Stats *stats;
+    Stage stage;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  void add(Stage stage, std::chrono::steady_clock::duration elapsed);
+  // counts a finished request with its transfer time, body size and
+  // redirects as reported by curl
+  void addResponse(const cpr::Response &response);
+  void addEmitted(size_t bytes) { emittedBytes += bytes; }
+
+  void printTable(std::ostream &out) const;
+  void printJson(std::ostream &out) const;
+
+private:
+  static const char *const STAGE_NAMES[STAGES];
+
+  std::array<std::atomic<uint64_t>, STAGES> nanos{};
+  std::array<std::atomic<uint64_t>, STAGES> counts{};
+  std::atomic<uint64_t> requests{0};
+  std::atomic<uint64_t> redirects{0};
+  std::atomic<uint64_t> transferNanos{0};
+  std::atomic<uint64_t> downloadedBytes{0};
+  std::atomic<uint64_t> emittedBytes{0};
+};
+
+#endif // STATS_HPP
@@ -0,0 +1,32 @@
+#ifndef SYNTHETIC_IMAGE_HPP
+#define SYNTHETIC_IMAGE_HPP
+
+#include <opencv2/opencv.hpp>
+
+// gradients, hard-edged shapes and noise, so neither the codecs nor the
+// SGR deduplication see an unrealistically easy image; `seed` varies the
+// shapes and the noise
+inline cv::Mat syntheticImage(int width, int height, int seed = 0) {
+  cv::Mat img(height, width, CV_8UC3);
+  for (int y = 0; y < height; y++) {
+    uchar *row = img.ptr<uchar>(y);
+    for (int x = 0; x < width; x++) {
+      row[x * 3] = static_cast<uchar>(x * 255 / width);
+      row[x * 3 + 1] = static_cast<uchar>(y * 255 / height);
+      row[x * 3 + 2] = static_cast<uchar>((x + y) * 255 / (width + height));
+    }
+  }
+  for (int i = seed; i < seed + 24; i++) {
+    cv::circle(img, cv::Point((i * 613) % width, (i * 397) % height),
+               height / 12 + (i * 37) % (height / 6),
+               cv::Scalar((i * 71) % 256, (i * 131) % 256, (i * 199) % 256),
+               cv::FILLED);
+  }
+  cv::Mat noise(img.size(), CV_8UC3);
+  cv::theRNG().state = 0x12345678u + seed;
+  cv::randn(noise, cv::Scalar::all(0), cv::Scalar::all(12));
+  img += noise;
+  return img;
+}
+
+#endif // SYNTHETIC_IMAGE_HPP
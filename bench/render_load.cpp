@@ -0,0 +1,288 @@
+// Load test for the render service (waifu-fetch --serve). Starts a stand-in
+// of the image API and CDN plus the service in this process, then drives
+// /render with keep-alive clients and reports frames per second and latency
+// percentiles. Nothing leaves the machine.
+//
+// Usage: render_load [--clients <n>] [--workers <n>] [--queue <n>]
+//                    [--seconds <s>] [--width <cells>] [--style <name>]
+//                    [--images <n>]
+
+#include "HttpServer.hpp"
+#include "RenderService.hpp"
+#include "SyntheticImage.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct ClientResult {
+  std::vector<double> latenciesMs;
+  size_t errors = 0;
+  size_t rejected = 0;
+  size_t bytes = 0;
+};
+
+int connectTo(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(static_cast<uint16_t>(port));
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) <
+      0) {
+    close(fd);
+    return -1;
+  }
+  int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  return fd;
+}
+
+// sends `request` and reads one response; false when the connection broke,
+// `keepAlive` false when the server is closing it
+bool roundTrip(int fd, const std::string &request, int &status,
+               size_t &bodyBytes, bool &keepAlive) {
+  if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) !=
+      static_cast<ssize_t>(request.size())) {
+    return false;
+  }
+  std::string buffer;
+  char chunk[64 * 1024];
+  size_t headEnd;
+  while ((headEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+    ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+    if (received <= 0) {
+      return false;
+    }
+    buffer.append(chunk, static_cast<size_t>(received));
+  }
+
+  status = std::atoi(buffer.c_str() + buffer.find(' ') + 1);
+  size_t length = buffer.find("Content-Length: ");
+  bodyBytes =
+      length < headEnd ? std::strtoul(buffer.c_str() + length + 16, nullptr,
+                                      10)
+                       : 0;
+  keepAlive = buffer.find("Connection: close") > headEnd;
+
+  size_t have = buffer.size() - headEnd - 4;
+  while (have < bodyBytes) {
+    ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+    if (received <= 0) {
+      return false;
+    }
+    have += static_cast<size_t>(received);
+  }
+  return true;
+}
+
+void runClient(int port, const std::string &request, Clock::time_point end,
+               ClientResult &result) {
+  int fd = -1;
+  bool first = true;
+  while (Clock::now() < end) {
+    if (fd < 0 && (fd = connectTo(port)) < 0) {
+      result.errors++;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      continue;
+    }
+    int status = 0;
+    size_t bodyBytes = 0;
+    bool keepAlive = true;
+    auto start = Clock::now();
+    bool ok = roundTrip(fd, request, status, bodyBytes, keepAlive);
+    double ms =
+        std::chrono::duration<double, std::milli>(Clock::now() - start)
+            .count();
+    if (!ok || !keepAlive) {
+      close(fd);
+      fd = -1;
+    }
+
+    // the first request fills the search queue and warms the connections
+    if (first) {
+      first = false;
+    } else if (ok && status == 200) {
+      result.latenciesMs.push_back(ms);
+      result.bytes += bodyBytes;
+    } else if (ok && status == 503) {
+      result.rejected++;
+    } else {
+      result.errors++;
+    }
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+double percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  size_t index = static_cast<size_t>(p * sorted.size());
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int clients = 8;
+  int workers = 4;
+  int queueDepth = 64;
+  int seconds = 10;
+  int width = 120;
+  int imageCount = 8;
+  std::string style = "detailed";
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--clients") {
+      clients = std::max(1, std::atoi(argv[i + 1]));
+    } else if (arg == "--workers") {
+      workers = std::max(1, std::atoi(argv[i + 1]));
+    } else if (arg == "--queue") {
+      queueDepth = std::max(1, std::atoi(argv[i + 1]));
+    } else if (arg == "--seconds") {
+      seconds = std::max(1, std::atoi(argv[i + 1]));
+    } else if (arg == "--width") {
+      width = std::max(1, std::atoi(argv[i + 1]));
+    } else if (arg == "--style") {
+      style = argv[i + 1];
+    } else if (arg == "--images") {
+      imageCount = std::max(1, std::atoi(argv[i + 1]));
+    } else {
+      std::fprintf(stderr, "Error: Unknown option: %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  // the stand-in origin: a search endpoint handing out URLs of a few
+  // synthetic JPEGs, served from memory
+  std::vector<std::vector<uchar>> images(imageCount);
+  for (int i = 0; i < imageCount; i++) {
+    cv::imencode(".jpg", syntheticImage(1280 + i * 64, 720 + i * 36, i),
+                 images[i], {cv::IMWRITE_JPEG_QUALITY, 90});
+  }
+  std::atomic<size_t> nextImage{0};
+  HttpServer::Options originOptions;
+  originOptions.workers = 4;
+  HttpServer *originPointer = nullptr;
+  HttpServer origin(originOptions, [&](const HttpServer::Request &request,
+                                       HttpServer::Response &response,
+                                       size_t) {
+    const std::string base =
+        "http://127.0.0.1:" + std::to_string(originPointer->port());
+    if (request.path == "/search") {
+      auto limit = request.query.find("limit");
+      int count = limit == request.query.end()
+                      ? 1
+                      : std::max(1, std::atoi(limit->second.c_str()));
+      response.contentType = "application/json";
+      response.body = "{\"images\":[";
+      for (int i = 0; i < count; i++) {
+        response.body += i ? ",{\"url\":\"" : "{\"url\":\"";
+        response.body += base + "/images/" +
+                         std::to_string(nextImage++ % images.size()) +
+                         ".jpg\"}";
+      }
+      response.body += "]}";
+      return;
+    }
+    size_t index = 0;
+    if (std::sscanf(request.path.c_str(), "/images/%zu.jpg", &index) != 1 ||
+        index >= images.size()) {
+      response.status = 404;
+      return;
+    }
+    response.contentType = "image/jpeg";
+    response.body.assign(images[index].begin(), images[index].end());
+  });
+  originPointer = &origin;
+  if (!origin.start()) {
+    return 1;
+  }
+
+  // the service under test, without disk caches so every request goes
+  // through download, decode and render
+  RenderService::Options serviceOptions;
+  serviceOptions.workers = workers;
+  serviceOptions.searchUrl =
+      "http://127.0.0.1:" + std::to_string(origin.port()) + "/search";
+  RenderService service(serviceOptions);
+  HttpServer::Options serverOptions;
+  serverOptions.workers = workers;
+  serverOptions.queueDepth = queueDepth;
+  HttpServer server(serverOptions, [&service](
+                                       const HttpServer::Request &request,
+                                       HttpServer::Response &response,
+                                       size_t worker) {
+    service.handle(request, response, worker);
+  });
+  if (!server.start()) {
+    return 1;
+  }
+
+  const std::string request = "GET /render?tag=waifu&width=" +
+                              std::to_string(width) + "&style=" + style +
+                              " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+  std::vector<ClientResult> results(clients);
+  std::vector<std::thread> threads;
+  auto start = Clock::now();
+  auto end = start + std::chrono::seconds(seconds);
+  for (int i = 0; i < clients; i++) {
+    threads.emplace_back(runClient, server.port(), std::cref(request), end,
+                         std::ref(results[i]));
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  const double elapsed =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  server.stop();
+  origin.stop();
+
+  ClientResult total;
+  for (const ClientResult &result : results) {
+    total.latenciesMs.insert(total.latenciesMs.end(),
+                             result.latenciesMs.begin(),
+                             result.latenciesMs.end());
+    total.errors += result.errors;
+    total.rejected += result.rejected;
+    total.bytes += result.bytes;
+  }
+  std::sort(total.latenciesMs.begin(), total.latenciesMs.end());
+  const size_t frames = total.latenciesMs.size();
+
+  std::printf("%d clients, %d workers, queue %d, %d cells wide, %s, "
+              "%.1f s\n",
+              clients, workers, queueDepth, width, style.c_str(), elapsed);
+  std::printf("frames %zu, rejected (503) %zu, errors %zu\n", frames,
+              total.rejected, total.errors);
+  std::printf("throughput %.1f frames/s, %.1f KiB/frame\n", frames / elapsed,
+              frames ? total.bytes / 1024.0 / frames : 0.0);
+  std::printf("latency ms: p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+              percentile(total.latenciesMs, 0.50),
+              percentile(total.latenciesMs, 0.90),
+              percentile(total.latenciesMs, 0.99),
+              frames ? total.latenciesMs.back() : 0.0);
+  return total.errors == 0 ? 0 : 1;
+}
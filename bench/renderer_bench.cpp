@@ -0,0 +1,198 @@
+// Times each stage of the ASCII pipeline separately, in nanoseconds per
+// output cell: decode, sample (resize + contrast + luma), map (glyphs and
+// escapes), palette quantization and emission.
+//
+// Usage: renderer_bench [--quick] [image files...]
+// Without files, synthetic JPEG and PNG images are generated in memory.
+
+#include "CellSampler.hpp"
+#include "FrameSink.hpp"
+#include "ImageDecoder.hpp"
+#include "ImageRenderer.hpp"
+#include "Palette.hpp"
+#include "SyntheticImage.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct TestImage {
+  std::string name;
+  std::vector<uchar> bytes;
+};
+
+struct Config {
+  const char *name;
+  ImageRenderer::CharStyle style;
+  bool color;
+  ImageRenderer::ColorMode mode;
+};
+
+using R = ImageRenderer;
+const Config CONFIGS[] = {
+    {"simple/gray", R::SIMPLE, false, R::TRUECOLOR},
+    {"detailed/24bit", R::DETAILED, true, R::TRUECOLOR},
+    {"detailed/256", R::DETAILED, true, R::XTERM_256},
+    {"blocks/16", R::BLOCKS, true, R::ANSI_16},
+    {"half/24bit", R::HALF_BLOCKS, true, R::TRUECOLOR},
+    {"quarter/24bit", R::QUARTER_BLOCKS, true, R::TRUECOLOR},
+    {"braille/256", R::BRAILLE, true, R::XTERM_256},
+};
+
+const cv::Size GRIDS[] = {{80, 24}, {120, 40}, {240, 80}};
+
+std::chrono::nanoseconds minTime{std::chrono::milliseconds(200)};
+
+// runs `stage` until minTime has passed (at least 3 times, after a warm-up
+// run) and returns the mean duration of one run in nanoseconds
+template <typename Stage> double timeStage(Stage &&stage) {
+  stage();
+  int runs = 0;
+  auto start = std::chrono::steady_clock::now();
+  auto elapsed = std::chrono::steady_clock::duration::zero();
+  while (runs < 3 || elapsed < minTime) {
+    stage();
+    runs++;
+    elapsed = std::chrono::steady_clock::now() - start;
+  }
+  return static_cast<double>(
+             std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                 .count()) /
+         runs;
+}
+
+bool readFile(const char *path, std::vector<uchar> &bytes) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  bytes.assign(std::istreambuf_iterator<char>(file),
+               std::istreambuf_iterator<char>());
+  return !bytes.empty();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<TestImage> images;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--quick") == 0) {
+      minTime = std::chrono::milliseconds(20);
+      continue;
+    }
+    TestImage image;
+    image.name = argv[i];
+    if (!readFile(argv[i], image.bytes)) {
+      std::fprintf(stderr, "Error: Cannot read %s\n", argv[i]);
+      return 1;
+    }
+    images.push_back(std::move(image));
+  }
+  if (images.empty()) {
+    cv::Mat img = syntheticImage(1920, 1080);
+    TestImage jpeg{"synthetic.jpg", {}};
+    TestImage png{"synthetic.png", {}};
+    cv::imencode(".jpg", img, jpeg.bytes, {cv::IMWRITE_JPEG_QUALITY, 90});
+    cv::imencode(".png", img, png.bytes);
+    images.push_back(std::move(jpeg));
+    images.push_back(std::move(png));
+  }
+
+  int devNull = open("/dev/null", O_WRONLY);
+  if (devNull < 0) {
+    std::perror("/dev/null");
+    return 1;
+  }
+  FdSink emitSink(devNull);
+  NullSink nullSink;
+  ImageRenderer renderer;
+  CellSampler sampler;
+  FrameBuffer frame;
+  const Palette &palette = Palette::xterm256();
+  std::vector<uint8_t> indices;
+
+  std::printf("%-16s %-8s %-15s %9s %9s %9s %9s %9s %9s\n", "image", "grid",
+              "config", "decode", "sample", "map", "quantize", "emit",
+              "B/cell");
+  std::printf("%-16s %-8s %-15s %9s %9s %9s %9s %9s %9s\n", "", "", "",
+              "ns/cell", "ns/cell", "ns/cell", "ns/cell", "ns/cell", "");
+
+  for (const TestImage &image : images) {
+    for (const cv::Size &grid : GRIDS) {
+      for (const Config &config : CONFIGS) {
+        ImageRenderer::RenderOptions options;
+        options.width = grid.width;
+        options.height = grid.height;
+        options.style = config.style;
+        options.colorSupport = config.color;
+        options.colorMode = config.mode;
+        // the grid is exactly width x height cells, so ns/cell is exact
+        options.aspectRatio = false;
+
+        int sx, sy;
+        ImageRenderer::samplesPerCell(config.style, sx, sy);
+        const double cells = static_cast<double>(grid.area());
+        const int sampleCols = grid.width * sx;
+        const int sampleRows = grid.height * sy;
+
+        cv::Mat decoded;
+        const double decodeNs = timeStage([&] {
+          decoded = ImageDecoder::decode(image.bytes.data(),
+                                         image.bytes.size(), sampleCols * 2,
+                                         sampleRows * 2, &decoded);
+        });
+        if (decoded.empty()) {
+          std::fprintf(stderr, "Error: Cannot decode %s\n",
+                       image.name.c_str());
+          return 1;
+        }
+
+        cv::Mat color(sampleRows, sampleCols, CV_8UC3);
+        cv::Mat luma(sampleRows, sampleCols, CV_8UC1);
+        const double sampleNs = timeStage([&] {
+          sampler.sample(decoded, options.contrast, options.brightness,
+                         color, luma, 0, sampleRows);
+        });
+
+        // a full render into the null sink, minus its sampling pass
+        const double renderNs = timeStage(
+            [&] { renderer.renderMat(decoded, options, nullSink); });
+        const double mapNs = std::max(0.0, renderNs - sampleNs);
+
+        indices.resize(sampleCols);
+        const double quantizeNs = timeStage([&] {
+          for (int y = 0; y < sampleRows; y++) {
+            palette.quantize(color.ptr<uchar>(y), sampleCols,
+                             indices.data());
+          }
+        });
+
+        std::string_view rendered =
+            renderer.renderToBuffer(decoded, options);
+        frame.clear();
+        frame.append(rendered.data(), rendered.size());
+        const double emitNs = timeStage([&] { frame.writeTo(emitSink); });
+
+        char gridName[16];
+        std::snprintf(gridName, sizeof(gridName), "%dx%d", grid.width,
+                      grid.height);
+        std::printf(
+            "%-16.16s %-8s %-15s %9.1f %9.2f %9.2f %9.2f %9.2f %9.1f\n",
+            image.name.c_str(), gridName, config.name, decodeNs / cells,
+            sampleNs / cells, mapNs / cells, quantizeNs / cells,
+            emitNs / cells, frame.size() / cells);
+        std::fflush(stdout);
+      }
+    }
+  }
+  close(devNull);
+  return 0;
+}
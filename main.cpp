@@ -1,111 +1,573 @@
+#include "BatchConverter.hpp"
+#include "BulkDownloader.hpp"
+#include "Daemon.hpp"
+#include "HttpClient.hpp"
 #include "ImageRenderer.hpp"
-#include "json.hpp"
+#include "ImageSearch.hpp"
+#include "RenderService.hpp"
+#include "Slideshow.hpp"
+#include "Stats.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <chrono>
 #include <cpr/cpr.h>
+#include <cstdint>
 #include <cstdio>
-#include <fstream>
+#include <cstdlib>
+#include <filesystem>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <opencv2/opencv.hpp>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
-using json = nlohmann::json;
+namespace {
 
-bool downloadImg(const std::string &imgUrl, const std::string &fileName);
-void displayImg(const std::string &fileName);
+// everything picked on the command line
+struct Settings {
+  std::vector<std::string> tags;
+  bool asciiMode = false;
+  bool useCache = true;
+  uint64_t cacheBytes = ImageCache::DEFAULT_MAX_BYTES;
+  int slideshowSeconds = 0;
+  int prefetch = 2;
+  // images per API request, 0 picks one for single images and a full
+  // batch for slideshows and downloads
+  int batchSize = 0;
+  std::string downloadDir;
+  size_t downloadCount = 100;
+  BulkDownloader::Options downloadOptions;
+  bool showStats = false;
+  bool statsJson = false;
+  ImageRenderer::RenderOptions opts;
+
+  Settings() {
+    opts.style = ImageRenderer::DETAILED;
+    opts.colorSupport = true;
+  }
+};
+
+// parses the flags in `args` from index `first` on; false (with a message
+// on `err`) when they are invalid
+bool parseFlags(const std::vector<std::string> &args, size_t first,
+                Settings &settings, std::ostream &err);
+
+// parses `args`, the tag list followed by the optional flags
+bool parseArguments(const std::vector<std::string> &args, Settings &settings,
+                    std::ostream &err) {
+  // images have to match every tag of a comma-separated list
+  if (!ImageSearch::parseTags(args[0], settings.tags)) {
+    err << "Error: Not a valid tag. Valid tags are:\n";
+    for (const std::string &t : ImageSearch::knownTags()) {
+      err << "- " << t << '\n';
+    }
+    return false;
+  }
+  return parseFlags(args, 1, settings, err);
+}
+
+bool parseFlags(const std::vector<std::string> &args, size_t first,
+                Settings &settings, std::ostream &err) {
+  ImageRenderer::RenderOptions &opts = settings.opts;
+  const size_t argc = args.size();
+  for (size_t i = first; i < argc; ++i) {
+    const std::string &arg = args[i];
+    if (arg == "--ascii") {
+      settings.asciiMode = true;
+    } else if (arg == "--colors" && i + 1 < argc) {
+      const std::string &mode = args[++i];
+      if (!ImageRenderer::parseColorMode(mode, opts.colorMode)) {
+        err << "Error: Unknown color mode: " << mode << std::endl;
+        return false;
+      }
+    } else if (arg == "--width" && i + 1 < argc) {
+      opts.width = std::max(1, std::atoi(args[++i].c_str()));
+    } else if (arg == "--height" && i + 1 < argc) {
+      opts.height = std::max(1, std::atoi(args[++i].c_str()));
+    } else if (arg == "--palette" && i + 1 < argc) {
+      opts.paletteFile = args[++i];
+    } else if (arg == "--protocol" && i + 1 < argc) {
+      const std::string &protocol = args[++i];
+      if (protocol == "sixel") {
+        opts.imageProtocol = InlineImageEncoder::SIXEL;
+      } else if (protocol == "kitty") {
+        opts.imageProtocol = InlineImageEncoder::KITTY;
+      } else if (protocol == "iterm") {
+        opts.imageProtocol = InlineImageEncoder::ITERM;
+      } else if (protocol == "none") {
+        opts.imageProtocol = InlineImageEncoder::NONE;
+      } else {
+        err << "Error: Unknown image protocol: " << protocol << std::endl;
+        return false;
+      }
+    } else if (arg == "--cell-size" && i + 1 < argc) {
+      // internal, sent by --client along with its terminal's protocol
+      if (std::sscanf(args[++i].c_str(), "%dx%d", &opts.cellWidth,
+                      &opts.cellHeight) != 2) {
+        err << "Error: Invalid cell size: " << args[i] << std::endl;
+        return false;
+      }
+    } else if (arg == "--style" && i + 1 < argc) {
+      const std::string &style = args[++i];
+      if (!ImageRenderer::parseStyle(style, opts.style)) {
+        err << "Error: Unknown style: " << style << std::endl;
+        return false;
+      }
+    } else if (arg == "--animate") {
+      opts.animate = true;
+    } else if (arg == "--loops" && i + 1 < argc) {
+      opts.loops = std::atoi(args[++i].c_str());
+    } else if (arg == "--no-cache") {
+      settings.useCache = false;
+    } else if (arg == "--cache-size" && i + 1 < argc) {
+      // a bad size would have the next LRU pass evict the whole cache
+      const std::string &size = args[++i];
+      char *end = nullptr;
+      errno = 0;
+      unsigned long long mib = std::strtoull(size.c_str(), &end, 10);
+      if (size.empty() || !std::isdigit(static_cast<unsigned char>(size[0])) ||
+          *end != '\0' || errno == ERANGE || mib == 0 ||
+          mib > UINT64_MAX / (1024 * 1024)) {
+        err << "Error: --cache-size takes a positive number of MiB: " << size
+            << std::endl;
+        return false;
+      }
+      settings.cacheBytes = mib * 1024 * 1024;
+    } else if (arg == "--slideshow" && i + 1 < argc) {
+      settings.slideshowSeconds = std::atoi(args[++i].c_str());
+    } else if (arg == "--prefetch" && i + 1 < argc) {
+      settings.prefetch = std::max(1, std::atoi(args[++i].c_str()));
+    } else if (arg == "--batch" && i + 1 < argc) {
+      settings.batchSize = std::atoi(args[++i].c_str());
+    } else if (arg == "--download" && i + 1 < argc) {
+      settings.downloadDir = args[++i];
+    } else if (arg == "--count" && i + 1 < argc) {
+      settings.downloadCount = std::strtoul(args[++i].c_str(), nullptr, 10);
+    } else if (arg == "--concurrency" && i + 1 < argc) {
+      settings.downloadOptions.concurrency =
+          std::max(1, std::atoi(args[++i].c_str()));
+    } else if (arg == "--per-host" && i + 1 < argc) {
+      settings.downloadOptions.perHost =
+          std::max(1, std::atoi(args[++i].c_str()));
+    } else if (arg == "--stats") {
+      settings.showStats = true;
+      if (i + 1 < argc && args[i + 1] == "json") {
+        settings.statsJson = true;
+        i++;
+      } else if (i + 1 < argc && args[i + 1] == "table") {
+        i++;
+      }
+    } else if (arg == "--progressive") {
+      opts.progressive = true;
+    } else if (arg == "--threads" && i + 1 < argc) {
+      opts.threads = std::atoi(args[++i].c_str());
+    } else {
+      err << "Error: Unknown option: " << arg << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+const char *protocolName(InlineImageEncoder::Protocol protocol) {
+  switch (protocol) {
+  case InlineImageEncoder::KITTY:
+    return "kitty";
+  case InlineImageEncoder::ITERM:
+    return "iterm";
+  case InlineImageEncoder::NONE:
+    return "none";
+  default:
+    return "sixel";
+  }
+}
+
+// the command line summary, on stderr
+void printUsage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " <tag>[,<tag>...] [--ascii]"
+               " [--style simple|detailed|blocks|half|quarter|braille]"
+               " [--colors truecolor|256|16]"
+               " [--palette <file>] [--threads <n>]"
+               " [--width <cells>] [--height <cells>]"
+               " [--progressive] [--protocol sixel|kitty|iterm|none]"
+               " [--animate] [--loops <n>]"
+               " [--no-cache] [--cache-size <MiB>]"
+               " [--slideshow <seconds>] [--prefetch <n>] [--batch <n>]"
+               " [--download <dir>] [--count <n>] [--concurrency <n>]"
+               " [--per-host <n>] [--stats [table|json]]"
+               " [--client [--socket <path>]]"
+            << std::endl;
+  std::cerr << "       " << program << " --daemon [--socket <path>]"
+            << std::endl;
+  std::cerr << "       " << program
+            << " --serve <port> [--workers <n>] [--queue <n>]"
+               " [--host <address>] [--origin <url>] [--no-cache]"
+            << std::endl;
+  std::cerr << "       " << program
+            << " --convert <dir> <output dir|archive.tar>"
+               " [--style <style>] [--colors <mode>] [--palette <file>]"
+               " [--width <cells>] [--height <cells>] [--threads <n>]"
+            << std::endl;
+  std::cerr << "Example: " << program << " waifu --ascii" << std::endl;
+}
+
+// forwards the command line to a running daemon, leaving out --client and
+// --socket; the terminal is the client's, so the image protocol and the
+// cell size are picked here rather than from the daemon's environment
+int runClient(int argc, char **argv) {
+  std::string socketPath = Daemon::defaultSocketPath();
+  std::vector<std::string> args;
+  bool ascii = false;
+  bool protocol = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--client") {
+      continue;
+    }
+    if (arg == "--socket" && i + 1 < argc) {
+      socketPath = argv[++i];
+      continue;
+    }
+    ascii = ascii || arg == "--ascii";
+    protocol = protocol || arg == "--protocol";
+    // the daemon runs in another directory, so paths are sent absolute
+    if (arg == "--palette" && i + 1 < argc) {
+      args.push_back(std::move(arg));
+      arg = std::filesystem::absolute(argv[++i]).string();
+    }
+    args.push_back(std::move(arg));
+  }
+  if (!ascii && !protocol) {
+    args.push_back("--protocol");
+    args.push_back(protocolName(InlineImageEncoder::detect()));
+  }
+  if (!ascii) {
+    int cellWidth, cellHeight;
+    InlineImageEncoder::cellSize(cellWidth, cellHeight);
+    args.push_back("--cell-size");
+    args.push_back(std::to_string(cellWidth) + "x" +
+                   std::to_string(cellHeight));
+  }
+
+  StdoutSink sink;
+  return Daemon::request(socketPath, args, sink) ? 0 : 1;
+}
+
+// answers requests for single frames, keeping one renderer, the caches,
+// the search queues and the HTTP connections alive between them
+int runDaemon(int argc, char **argv) {
+  std::string socketPath = Daemon::defaultSocketPath();
+  for (int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--socket" && i + 1 < argc) {
+      socketPath = argv[++i];
+    } else {
+      std::cerr << "Error: Unknown option: " << arg << std::endl;
+      return 1;
+    }
+  }
+
+  Daemon daemon(socketPath);
+  if (!daemon.listen()) {
+    return 1;
+  }
+
+  HttpClient http;
+  ImageCache cache(ImageCache::defaultDirectory());
+  FrameCache frameCache(ImageCache::defaultDirectory() + "/frames");
+  cache.setHttpClient(&http);
+  ImageRenderer renderer;
+  renderer.setCache(&cache);
+  renderer.setFrameCache(&frameCache);
+  renderer.setHttpClient(&http);
+  // one queue per tag list, so most requests skip the search round trip
+  std::map<std::string, std::unique_ptr<ImageSearch>> searches;
+
+  std::cerr << "Listening on " << socketPath << std::endl;
+  daemon.serve([&](const std::vector<std::string> &args, std::string &reply) {
+    std::ostringstream err;
+    Settings request;
+    if (args.empty()) {
+      reply = "Error: Missing tag.\n";
+      return false;
+    }
+    if (!parseArguments(args, request, err)) {
+      reply = err.str();
+      return false;
+    }
+    if (request.slideshowSeconds > 0 || !request.downloadDir.empty() ||
+        request.opts.animate || request.showStats) {
+      reply = "Error: --slideshow, --download, --animate and --stats are not "
+              "available through the daemon.\n";
+      return false;
+    }
+    // the caches are the daemon's, set up once when it started
+    if (!request.useCache ||
+        request.cacheBytes != ImageCache::DEFAULT_MAX_BYTES) {
+      reply = "Error: --no-cache and --cache-size are not available through "
+              "the daemon.\n";
+      return false;
+    }
+    // the frame is sent back whole, so there is nothing to refine in place
+    request.opts.progressive = false;
+
+    std::unique_ptr<ImageSearch> &search = searches[args[0]];
+    if (!search) {
+      search = std::make_unique<ImageSearch>(
+          request.tags,
+          request.batchSize > 0 ? request.batchSize : ImageSearch::MAX_BATCH);
+      search->setHttpClient(&http);
+    }
+    std::string imgUrl;
+    if (!search->next(imgUrl)) {
+      reply = "Error: No image found.\n";
+      return false;
+    }
+
+    StringSink sink(reply);
+    if (request.asciiMode ? renderer.urlToAscii(imgUrl, request.opts, sink)
+                          : renderer.urlToImage(imgUrl, request.opts, sink)) {
+      return true;
+    }
+    reply = "Failed to display image.\n";
+    return false;
+  });
+  return 0;
+}
+
+// serves frames over HTTP until SIGINT or SIGTERM
+int runServer(int argc, char **argv) {
+  HttpServer::Options serverOptions;
+  char *end = nullptr;
+  errno = 0;
+  long port = std::strtol(argv[2], &end, 10);
+  if (*argv[2] == '\0' || *end != '\0' || errno == ERANGE || port < 1 ||
+      port > 65535) {
+    std::cerr << "Error: Not a port number: " << argv[2] << std::endl;
+    return 1;
+  }
+  serverOptions.port = static_cast<int>(port);
+  RenderService::Options serviceOptions;
+  serviceOptions.cacheDirectory = ImageCache::defaultDirectory();
+  for (int i = 3; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--workers" && i + 1 < argc) {
+      serverOptions.workers = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--queue" && i + 1 < argc) {
+      serverOptions.queueDepth = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--host" && i + 1 < argc) {
+      serverOptions.host = argv[++i];
+    } else if (arg == "--origin" && i + 1 < argc) {
+      serviceOptions.searchUrl = std::string(argv[++i]) + "/search";
+    } else if (arg == "--no-cache") {
+      serviceOptions.cacheDirectory.clear();
+    } else {
+      std::cerr << "Error: Unknown option: " << arg << std::endl;
+      return 1;
+    }
+  }
+  serviceOptions.workers = serverOptions.workers;
+
+  // blocked before any thread starts, so only sigwait below sees them
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  RenderService service(serviceOptions);
+  HttpServer server(serverOptions,
+                    [&service](const HttpServer::Request &request,
+                               HttpServer::Response &response,
+                               size_t worker) {
+                      service.handle(request, response, worker);
+                    });
+  if (!server.start()) {
+    return 1;
+  }
+  std::cerr << "Serving on http://" << serverOptions.host << ":"
+            << server.port() << "/render" << std::endl;
+
+  int signal;
+  sigwait(&signals, &signal);
+  server.stop();
+  return 0;
+}
+
+// renders every image below a directory, see BatchConverter
+int runConverter(int argc, char **argv) {
+  const std::vector<std::string> args(argv + 4, argv + argc);
+  // only the flags that shape the frames apply, each takes one value
+  static const std::string allowed[] = {"--style",  "--colors", "--palette",
+                                        "--width",  "--height", "--threads"};
+  for (size_t i = 0; i < args.size(); i += 2) {
+    if (std::find(std::begin(allowed), std::end(allowed), args[i]) ==
+        std::end(allowed)) {
+      std::cerr << "Error: " << args[i] << " is not available with --convert"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  Settings settings;
+  settings.opts.threads = 0;
+  if (!parseFlags(args, 0, settings, std::cerr)) {
+    return 1;
+  }
+  // --threads sizes the pool here, each image renders on one thread
+  BatchConverter converter(settings.opts, settings.opts.threads);
+  return converter.convert(argv[2], argv[3]) == 0 ? 0 : 1;
+}
+
+} // namespace
 
 int main(int argc, char **argv) {
+  // the client only relays bytes, so it skips all of the setup below
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--client") {
+      return runClient(argc, argv);
+    }
+  }
+
   std::setlocale(LC_ALL, "en_US.UTF-8");
   std::locale::global(std::locale("en_US.UTF-8"));
 
   std::ios_base::sync_with_stdio(false);
   std::cin.tie(NULL);
 
-  std::string tags[] = {"maid",          "waifu",         "marin-kitagawa",
-                        "mori-calliope", "raiden-shogun", "oppai",
-                        "selfies",       "uniform",       "kamisato-ayaka"};
-  if (argc < 2 || argc > 3) {
-    std::cerr << "Usage: " << argv[0] << " <tag> [--ascii]" << std::endl;
-    std::cerr << "Example: " << argv[0] << " waifu --ascii" << std::endl;
+  if (argc < 2) {
+    printUsage(argv[0]);
     return 1;
   }
-  std::string tag = std::string(argv[1]);
-  bool found = false;
-  for (const std::string &t : tags) {
-    if (t == tag) {
-      found = true;
-      break;
-    }
+  if (std::string(argv[1]) == "--daemon") {
+    return runDaemon(argc, argv);
   }
-  if (!found) {
-    std::cerr << "Error: Not a valid tag. Valid tags are:\n";
-    for (const std::string &t : tags) {
-      std::cerr << "- " << t << '\n';
+  if (std::string(argv[1]) == "--serve") {
+    if (argc < 3) {
+      printUsage(argv[0]);
+      return 1;
     }
+    return runServer(argc, argv);
+  }
+  if (std::string(argv[1]) == "--convert" && argc >= 4) {
+    return runConverter(argc, argv);
+  }
+
+  Settings settings;
+  if (!parseArguments(std::vector<std::string>(argv + 1, argv + argc),
+                      settings, std::cerr)) {
     return 1;
   }
+  const ImageRenderer::RenderOptions &opts = settings.opts;
 
-  bool asciiMode = false;
-  // check for the --ascii flag
-  for (int i = 2; i < argc; ++i) {
-    if (std::string(argv[i]) == "--ascii") {
-      asciiMode = true;
-      break;
-    }
+  // timings go to stderr, so they never end up mixed into a frame
+  std::unique_ptr<Stats> stats;
+  if (settings.showStats) {
+    stats = std::make_unique<Stats>();
   }
+  auto reportStats = [&] {
+    if (stats && settings.statsJson) {
+      stats->printJson(std::cerr);
+    } else if (stats) {
+      stats->printTable(std::cerr);
+    }
+  };
 
-  std::string url = "https://api.waifu.im/search";
-  auto response =
-      cpr::Get(cpr::Url{url}, cpr::Parameters{{"included_tags", tag}});
+  // search and download share connections where they go to the same host
+  HttpClient http;
+  std::unique_ptr<ImageCache> cache;
+  std::unique_ptr<FrameCache> frameCache;
+  if (settings.useCache) {
+    cache = std::make_unique<ImageCache>(ImageCache::defaultDirectory(),
+                                         settings.cacheBytes);
+    frameCache = std::make_unique<FrameCache>(ImageCache::defaultDirectory() +
+                                              "/frames");
+    cache->setStats(stats.get());
+    cache->setHttpClient(&http);
+  }
 
-  if (response.status_code != 200) {
-    std::cerr << "Error: API request failed. Status: " << response.status_code
-              << std::endl;
-    return 1;
+  int batchSize = settings.batchSize;
+  if (batchSize <= 0) {
+    batchSize = settings.slideshowSeconds > 0 || !settings.downloadDir.empty()
+                    ? ImageSearch::MAX_BATCH
+                    : 1;
   }
+  ImageSearch search(settings.tags, batchSize);
+  search.setStats(stats.get());
+  search.setHttpClient(&http);
 
-  try {
-    json data = json::parse(response.text);
-    if (!data.contains("images") || !data["images"].is_array() ||
-        data["images"].empty()) {
-      std::cerr << "Error: API response doesn't contain valid image data.\n";
-      return 1;
+  if (!settings.downloadDir.empty()) {
+    // search results repeat, so asking a few times more often than needed
+    // for `downloadCount` new images, already downloaded ones being skipped
+    const size_t downloadCount = settings.downloadCount;
+    BulkDownloader downloader(settings.downloadDir, settings.downloadOptions);
+    downloader.setStats(stats.get());
+    std::string imgUrl;
+    for (size_t i = 0;
+         i < downloadCount * 4 && downloader.queued() < downloadCount &&
+         search.next(imgUrl);
+         i++) {
+      downloader.add(imgUrl);
     }
-    std::string imgUrl = data["images"][0]["url"];
-
-    if (asciiMode) {
-      ImageRenderer renderer;
-      ImageRenderer::RenderOptions opts;
-      opts.style = ImageRenderer::DETAILED;
-      opts.colorSupport = true;
+    const size_t failed = downloader.run();
+    reportStats();
+    return failed == 0 ? 0 : 1;
+  }
 
-      renderer.urlToAscii(imgUrl, opts);
-    } else {
-      std::string tempFile = "temp_img.jpg";
+  if (settings.slideshowSeconds > 0) {
+    // downloading, decoding and mapping overlap with showing the previous
+    // image, so only searches and the writes to the terminal are recorded
+    Slideshow slideshow(
+        [&search](std::string &imgUrl) { return search.next(imgUrl); }, opts,
+        settings.asciiMode, settings.prefetch);
+    slideshow.setCache(cache.get());
+    slideshow.setFrameCache(frameCache.get());
+    slideshow.setHttpClient(&http);
+    slideshow.start();
 
-      if (downloadImg(imgUrl, tempFile)) {
-        displayImg(tempFile);
-        remove(tempFile.c_str());
-      } else {
-        std::cout << "Failed to download image." << std::endl;
+    // the next frames are fetched and rendered while this one is shown
+    StdoutSink sink;
+    std::string frame;
+    auto deadline = std::chrono::steady_clock::now();
+    while (slideshow.next(frame)) {
+      std::this_thread::sleep_until(deadline);
+      {
+        Stats::Timer timer(stats.get(), Stats::EMIT);
+        sink.write(frame.data(), frame.size());
+      }
+      if (stats) {
+        stats->addEmitted(frame.size());
       }
+      deadline = std::chrono::steady_clock::now() +
+                 std::chrono::seconds(settings.slideshowSeconds);
     }
-  } catch (const json::parse_error &e) {
-    std::cerr << "Error: Failed to parse API response. " << e.what()
-              << std::endl;
+    std::cerr << "Error: No more images to show." << std::endl;
+    reportStats();
     return 1;
   }
-  return 0;
-}
 
-bool downloadImg(const std::string &imgUrl, const std::string &fileName) {
-  std::ofstream of(fileName, std::ios::binary);
-  auto response = cpr::Download(of, cpr::Url{imgUrl});
-  if (response.status_code == 200) {
-    return true;
+  std::string imgUrl;
+  if (!search.next(imgUrl)) {
+    reportStats();
+    return 1;
   }
-  return false;
-}
 
-void displayImg(const std::string &fileName) {
-  system(("chafa " + fileName).c_str());
+  ImageRenderer renderer;
+  renderer.setCache(cache.get());
+  renderer.setFrameCache(frameCache.get());
+  renderer.setStats(stats.get());
+  renderer.setHttpClient(&http);
+  if (settings.asciiMode) {
+    renderer.urlToAscii(imgUrl, opts);
+  } else if (!renderer.urlToImage(imgUrl, opts)) {
+    std::cout << "Failed to display image." << std::endl;
+  }
+  reportStats();
+  return 0;
 }